@@ -1,6 +1,23 @@
 #include <iostream>      
 #include <string>        
 #include <stdexcept>     
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <algorithm>
+#include <functional>
 using namespace std;     
 
 
@@ -48,8 +65,44 @@ public:
 };
 
 
+// Типизированный стек без ограничения глубины: хранит значения как есть,
+// растёт удвоением и переиспользует память после clear()
+template <typename T>
+class TypedStack {
+private:
+    vector<T> data;      // Буфер элементов
+    size_t head = 0;     // Количество элементов в стеке
+
+public:
+    void reserve(size_t size) {                    // Выделение памяти заранее
+        if (data.size() < size) data.resize(size);
+    }
+
+    void push(T value) {
+        if (head == data.size()) data.resize(data.empty() ? 16 : data.size() * 2);
+        data[head++] = value;
+    }
+
+    T pop() {
+        if (head == 0) throw underflow_error("Stack is empty");
+        return data[--head];
+    }
+
+    T peek() const {
+        if (head == 0) throw underflow_error("Stack is empty");
+        return data[head - 1];
+    }
+
+    bool isEmpty() const { return head == 0; }
+
+    size_t size() const { return head; }
+
+    void clear() { head = 0; }                     // Память не освобождается
+};
+
+
 // Функция для определения приоритета операторов
-int priority(char op) {
+constexpr int priority(char op) {
     switch (op) {
         case '!': return 3;          // NOT — наивысший приоритет
         case '&': return 2;          // AND
@@ -131,14 +184,1601 @@ int evaluate(string expr) {
 }
 
 
-int main() {
+// Применяет оператор с вершины стека операторов к стеку значений
+static void reduceTop(TypedStack<unsigned char>& values, TypedStack<char>& ops) {
+    char op = ops.pop();
+    if (values.size() < (op == '!' ? 1u : 2u)) {
+        throw invalid_argument("Некорректное выражение: не хватает операнда");
+    }
+    if (op == '!') {
+        values.push((unsigned char)applyOp(op, values.pop()));
+    } else {
+        int b = values.pop();
+        int a = values.pop();
+        values.push((unsigned char)applyOp(op, a, b));
+    }
+}
+
+// Вычисление выражения на типизированных стеках: без строк на каждый токен,
+// без to_string/stoi и без ограничения глубины. Буферы выделяются один раз
+// по длине выражения и переиспользуются между вызовами в том же потоке
+int evaluateFast(string_view expr) {
+    thread_local TypedStack<unsigned char> values;
+    thread_local TypedStack<char> ops;
+    values.clear();
+    ops.clear();
+    values.reserve(expr.length() + 1);
+    ops.reserve(expr.length() + 1);
+    bool afterOperand = false;                      // Предыдущий токен — операнд или ')'
+
+    for (size_t i = 0; i < expr.length(); i++) {
+        char c = expr[i];
+        if (c == ' ' || c == '\t' || c == '\r') continue;
+        if (c == '!' && afterOperand) throw invalid_argument("Оператор ! допустим только перед операндом");
+        afterOperand = c == '0' || c == '1' || c == ')';
+
+        if (c == '0' || c == '1') {
+            values.push((unsigned char)(c - '0'));
+        }
+        else if (c == '(' || c == '!') {            // '!' унарный префиксный: ничего не выталкиваем
+            ops.push(c);
+        }
+        else if (c == ')') {
+            while (!ops.isEmpty() && ops.peek() != '(') reduceTop(values, ops);
+            if (ops.isEmpty()) throw invalid_argument("Лишняя закрывающая скобка");
+            ops.pop();                                // Удаляем '('
+        }
+        else if (c == '&' || c == '|' || c == '^') {
+            while (!ops.isEmpty() && ops.peek() != '(' && priority(ops.peek()) >= priority(c)) {
+                reduceTop(values, ops);
+            }
+            ops.push(c);
+        }
+        else {
+            throw invalid_argument(string("Неизвестный символ: ") + c);
+        }
+    }
+
+    while (!ops.isEmpty()) {
+        if (ops.peek() == '(') throw invalid_argument("Незакрытая скобка");
+        reduceTop(values, ops);
+    }
+    if (values.size() != 1) throw invalid_argument("Некорректное выражение");
+    return values.pop();
+}
+
+
+// ---------- Компиляция выражения в постфиксную программу ----------
+
+// Коды инструкций скомпилированной программы
+enum OpCode : unsigned char {
+    OP_CONST,   // Положить на стек константу arg (0 или 1)
+    OP_VAR,     // Положить на стек значение переменной с индексом arg
+    OP_NOT,     // Логическое NOT над вершиной стека
+    OP_AND,     // Логическое AND двух верхних значений
+    OP_OR,      // Логическое OR двух верхних значений
+    OP_XOR,     // Логическое XOR двух верхних значений
+    OP_JF,      // Если на вершине 0 — перейти к инструкции arg (вершина остаётся)
+    OP_JT       // Если на вершине 1 — перейти к инструкции arg (вершина остаётся)
+};
+
+// Одна инструкция программы
+struct Instr {
+    OpCode op;
+    unsigned arg;        // Константа, индекс переменной или адрес перехода
+};
+
+// Скомпилированное выражение: разбирается один раз, вычисляется многократно
+struct Program {
+    vector<Instr> code;      // Инструкции в постфиксном порядке
+    vector<string> vars;     // Имена переменных, индекс совпадает с arg в OP_VAR
+    size_t maxDepth = 0;     // Максимальная глубина стека значений при вычислении
+};
+
+// Индекс переменной в программе (-1, если такой переменной нет)
+int findVar(const Program& prog, const string& name) {
+    for (size_t i = 0; i < prog.vars.size(); i++) {
+        if (prog.vars[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+// Добавляет в программу инструкцию оператора и проверяет глубину стека
+static void emitOp(Program& prog, char op, size_t& depth) {
+    size_t need = (op == '!') ? 1 : 2;
+    if (depth < need) {
+        throw invalid_argument("Некорректное выражение: не хватает операнда");
+    }
+    switch (op) {
+        case '!': prog.code.push_back({OP_NOT, 0}); break;
+        case '&': prog.code.push_back({OP_AND, 0}); depth--; break;
+        case '|': prog.code.push_back({OP_OR, 0}); depth--; break;
+        case '^': prog.code.push_back({OP_XOR, 0}); depth--; break;
+        default: throw invalid_argument("Неизвестный оператор");
+    }
+}
+
+// Добавляет в программу операнд (константу или переменную)
+static void emitValue(Program& prog, Instr instr, size_t& depth) {
+    prog.code.push_back(instr);
+    depth++;
+    if (depth > prog.maxDepth) prog.maxDepth = depth;
+}
+
+// Компиляция выражения в постфиксную программу (алгоритм сортировочной станции).
+// Кроме литералов 0/1 допускаются переменные: буква или '_', далее буквы, цифры, '_'
+Program compile(const string& expr) {
+    Program prog;
+    vector<char> ops;        // Стек операторов
+    size_t depth = 0;        // Текущая глубина стека значений
+    bool afterOperand = false;   // Предыдущий токен — операнд или ')'
+
+    for (size_t i = 0; i < expr.length(); i++) {
+        char c = expr[i];
+        if (c == ' ' || c == '\t') continue;
+        if (c == '!' && afterOperand) throw invalid_argument("Оператор ! допустим только перед операндом");
+        afterOperand = c == '0' || c == '1' || c == ')' || isalpha((unsigned char)c) || c == '_';
+
+        if (c == '0' || c == '1') {
+            emitValue(prog, {OP_CONST, (unsigned)(c - '0')}, depth);
+        }
+        else if (isalpha((unsigned char)c) || c == '_') {
+            size_t start = i;
+            while (i + 1 < expr.length() && (isalnum((unsigned char)expr[i + 1]) || expr[i + 1] == '_')) i++;
+            string name = expr.substr(start, i - start + 1);
+            int idx = findVar(prog, name);
+            if (idx < 0) {
+                idx = (int)prog.vars.size();
+                prog.vars.push_back(name);
+            }
+            emitValue(prog, {OP_VAR, (unsigned)idx}, depth);
+        }
+        else if (c == '(') {
+            ops.push_back(c);
+        }
+        else if (c == ')') {
+            while (!ops.empty() && ops.back() != '(') {
+                emitOp(prog, ops.back(), depth);
+                ops.pop_back();
+            }
+            if (ops.empty()) throw invalid_argument("Лишняя закрывающая скобка");
+            ops.pop_back();                          // Удаляем '('
+        }
+        else if (c == '!') {
+            ops.push_back(c);                        // Унарный префиксный: ничего не выталкиваем
+        }
+        else if (c == '&' || c == '|' || c == '^') {
+            while (!ops.empty() && ops.back() != '(' && priority(ops.back()) >= priority(c)) {
+                emitOp(prog, ops.back(), depth);
+                ops.pop_back();
+            }
+            ops.push_back(c);
+        }
+        else {
+            throw invalid_argument(string("Неизвестный символ: ") + c);
+        }
+    }
+
+    while (!ops.empty()) {
+        if (ops.back() == '(') throw invalid_argument("Незакрытая скобка");
+        emitOp(prog, ops.back(), depth);
+        ops.pop_back();
+    }
+    if (depth != 1) throw invalid_argument("Некорректное выражение");
+    return prog;
+}
+
+// Глубина стека, при которой вычисление обходится буфером на стеке вызовов
+const size_t INLINE_DEPTH = 256;
+
+// Выполнение программы на заранее выделенном стеке значений
+static int runProgram(const Program& prog, const vector<int>& values, unsigned char* st) {
+    size_t top = 0;
+    size_t pc = 0;
+    while (pc < prog.code.size()) {
+        const Instr& in = prog.code[pc++];
+        switch (in.op) {
+            case OP_CONST: st[top++] = (unsigned char)in.arg; break;
+            case OP_VAR:   st[top++] = values[in.arg] != 0; break;
+            case OP_NOT:   st[top - 1] ^= 1; break;
+            case OP_AND:   top--; st[top - 1] &= st[top]; break;
+            case OP_OR:    top--; st[top - 1] |= st[top]; break;
+            case OP_XOR:   top--; st[top - 1] ^= st[top]; break;
+            case OP_JF:    if (!st[top - 1]) pc = in.arg; break;
+            case OP_JT:    if (st[top - 1]) pc = in.arg; break;
+        }
+    }
+    return st[0];
+}
+
+// Вычисление скомпилированной программы; values[i] — значение переменной prog.vars[i].
+// Разбора текста нет, а для выражений глубиной до INLINE_DEPTH нет и выделения памяти
+int evaluate(const Program& prog, const vector<int>& values) {
+    if (values.size() < prog.vars.size()) {
+        throw invalid_argument("Заданы значения не всех переменных");
+    }
+    if (prog.maxDepth <= INLINE_DEPTH) {
+        unsigned char st[INLINE_DEPTH];
+        return runProgram(prog, values, st);
+    }
+    vector<unsigned char> st(prog.maxDepth);
+    return runProgram(prog, values, st.data());
+}
+
+
+// ---------- Побитово-параллельное вычисление ----------
+
+// Широкая «полоса» из четырёх 64-битных слов: 256 наборов значений за операцию.
+// Поэлементные циклы компилятор разворачивает в SIMD-инструкции, где они доступны
+struct Lane256 {
+    uint64_t w[4];
+};
+
+inline Lane256 operator&(const Lane256& a, const Lane256& b) {
+    Lane256 r;
+    for (int i = 0; i < 4; i++) r.w[i] = a.w[i] & b.w[i];
+    return r;
+}
+
+inline Lane256 operator|(const Lane256& a, const Lane256& b) {
+    Lane256 r;
+    for (int i = 0; i < 4; i++) r.w[i] = a.w[i] | b.w[i];
+    return r;
+}
+
+inline Lane256 operator^(const Lane256& a, const Lane256& b) {
+    Lane256 r;
+    for (int i = 0; i < 4; i++) r.w[i] = a.w[i] ^ b.w[i];
+    return r;
+}
+
+inline Lane256 operator~(const Lane256& a) {
+    Lane256 r;
+    for (int i = 0; i < 4; i++) r.w[i] = ~a.w[i];
+    return r;
+}
+
+// Полоса, во всех битах которой записана константа bit
+template <typename Lane>
+Lane laneConst(unsigned bit);
+
+template <>
+inline uint64_t laneConst<uint64_t>(unsigned bit) { return bit ? ~0ULL : 0ULL; }
+
+template <>
+inline Lane256 laneConst<Lane256>(unsigned bit) {
+    uint64_t v = bit ? ~0ULL : 0ULL;
+    return Lane256{{v, v, v, v}};
+}
+
+// Проверка, что во всех битах полосы записана константа bit
+inline bool laneEquals(uint64_t lane, unsigned bit) { return lane == laneConst<uint64_t>(bit); }
+
+inline bool laneEquals(const Lane256& lane, unsigned bit) {
+    uint64_t v = laneConst<uint64_t>(bit);
+    return lane.w[0] == v && lane.w[1] == v && lane.w[2] == v && lane.w[3] == v;
+}
+
+// Выполнение программы сразу над всеми битами полосы.
+// load(v) возвращает полосу значений переменной v, st — стек глубиной prog.maxDepth
+template <typename Lane, typename LoadVar>
+Lane runLanes(const Program& prog, LoadVar load, Lane* st) {
+    size_t top = 0;
+    size_t pc = 0;
+    while (pc < prog.code.size()) {
+        const Instr& in = prog.code[pc++];
+        switch (in.op) {
+            case OP_CONST: st[top++] = laneConst<Lane>(in.arg); break;
+            case OP_VAR:   st[top++] = load(in.arg); break;
+            case OP_NOT:   st[top - 1] = ~st[top - 1]; break;
+            case OP_AND:   top--; st[top - 1] = st[top - 1] & st[top]; break;
+            case OP_OR:    top--; st[top - 1] = st[top - 1] | st[top]; break;
+            case OP_XOR:   top--; st[top - 1] = st[top - 1] ^ st[top]; break;
+            case OP_JF:    if (laneEquals(st[top - 1], 0)) pc = in.arg; break;  // Переход, только если
+            case OP_JT:    if (laneEquals(st[top - 1], 1)) pc = in.arg; break;  // решены все биты полосы
+        }
+    }
+    return st[0];
+}
+
+// Пакетное вычисление по столбцам: columns[v] — упакованные значения переменной v
+// (бит j слова k — значение в записи 64*k + j). Бит результата — значение выражения в записи
+vector<uint64_t> evaluateBatch(const Program& prog, const vector<vector<uint64_t>>& columns) {
+    if (columns.size() < prog.vars.size()) {
+        throw invalid_argument("Заданы значения не всех переменных");
+    }
+    size_t words = prog.vars.empty() ? 1 : columns[0].size();
+    for (size_t v = 0; v < prog.vars.size(); v++) {
+        if (columns[v].size() != words) throw invalid_argument("Столбцы разной длины");
+    }
+
+    vector<uint64_t> result(words);
+    vector<Lane256> wideStack(prog.maxDepth);
+    vector<uint64_t> narrowStack(prog.maxDepth);
+
+    size_t k = 0;
+    for (; k + 4 <= words; k += 4) {                  // Основная часть — по 256 записей
+        auto load = [&](unsigned v) {
+            Lane256 lane;
+            memcpy(lane.w, columns[v].data() + k, sizeof(lane.w));
+            return lane;
+        };
+        Lane256 r = runLanes<Lane256>(prog, load, wideStack.data());
+        memcpy(result.data() + k, r.w, sizeof(r.w));
+    }
+    for (; k < words; k++) {                          // Хвост — по 64 записи
+        auto load = [&](unsigned v) { return columns[v][k]; };
+        result[k] = runLanes<uint64_t>(prog, load, narrowStack.data());
+    }
+    return result;
+}
+
+// Маски значений переменных 0..5 внутри одного 64-битного слова таблицы истинности
+static const uint64_t TRUTH_MASKS[6] = {
+    0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+};
+
+// Значения переменной v в слове k таблицы истинности
+static inline uint64_t truthWord(unsigned v, size_t k) {
+    if (v < 6) return TRUTH_MASKS[v];
+    return ((k >> (v - 6)) & 1) ? ~0ULL : 0ULL;
+}
+
+// Полная таблица истинности: бит i результата — значение выражения на наборе i,
+// где бит v числа i задаёт значение переменной prog.vars[v]
+vector<uint64_t> truthTable(const Program& prog) {
+    size_t n = prog.vars.size();
+    if (n > 30) throw invalid_argument("Слишком много переменных для таблицы истинности");
+
+    size_t words = n <= 6 ? 1 : ((size_t)1 << (n - 6));
+    vector<uint64_t> result(words);
+    vector<Lane256> wideStack(prog.maxDepth);
+    vector<uint64_t> narrowStack(prog.maxDepth);
+
+    size_t k = 0;
+    for (; k + 4 <= words; k += 4) {
+        auto load = [&](unsigned v) {
+            return Lane256{{truthWord(v, k), truthWord(v, k + 1), truthWord(v, k + 2), truthWord(v, k + 3)}};
+        };
+        Lane256 r = runLanes<Lane256>(prog, load, wideStack.data());
+        memcpy(result.data() + k, r.w, sizeof(r.w));
+    }
+    for (; k < words; k++) {
+        auto load = [&](unsigned v) { return truthWord(v, k); };
+        result[k] = runLanes<uint64_t>(prog, load, narrowStack.data());
+    }
+    if (n < 6) result[0] &= (1ULL << (1u << n)) - 1;  // Отбрасываем несуществующие наборы
+    return result;
+}
+
+
+// ---------- Оптимизация скомпилированного выражения ----------
+
+// Построитель дерева выражения с упрощениями. Одинаковые поддеревья получают
+// один номер узла, поэтому проверка x == y — сравнение номеров
+class ExprOptimizer {
+public:
+    struct Node {
+        OpCode op;
+        unsigned a, b;       // Константа / индекс переменной / номера потомков
+        size_t size;         // Число узлов в поддереве — оценка стоимости вычисления
+    };
+    vector<Node> nodes;
+
+private:
+    map<tuple<int, unsigned, unsigned>, unsigned> unique;  // (op, a, b) -> номер узла
+
+    unsigned make(OpCode op, unsigned a, unsigned b) {
+        auto key = make_tuple((int)op, a, b);
+        auto it = unique.find(key);
+        if (it != unique.end()) return it->second;
+        size_t size = 1;
+        if (op == OP_NOT) size += nodes[a].size;
+        else if (op != OP_CONST && op != OP_VAR) size += nodes[a].size + nodes[b].size;
+        nodes.push_back({op, a, b, size});
+        unique[key] = (unsigned)nodes.size() - 1;
+        return (unsigned)nodes.size() - 1;
+    }
+
+    bool isConst(unsigned x, unsigned value) const {
+        return nodes[x].op == OP_CONST && nodes[x].a == value;
+    }
+
+    bool isNegation(unsigned x, unsigned y) const {    // x == !y или y == !x
+        return (nodes[x].op == OP_NOT && nodes[x].a == y) || (nodes[y].op == OP_NOT && nodes[y].a == x);
+    }
+
+public:
+    unsigned constant(unsigned value) { return make(OP_CONST, value, 0); }
+
+    unsigned variable(unsigned index) { return make(OP_VAR, index, 0); }
+
+    unsigned makeNot(unsigned x) {
+        if (nodes[x].op == OP_CONST) return constant(!nodes[x].a);  // !0, !1
+        if (nodes[x].op == OP_NOT) return nodes[x].a;                // !!x = x
+        return make(OP_NOT, x, 0);
+    }
+
+    unsigned makeBinary(OpCode op, unsigned x, unsigned y) {
+        switch (op) {
+            case OP_AND:
+                if (isConst(x, 0) || isConst(y, 0)) return constant(0);   // x & 0 = 0
+                if (isConst(x, 1)) return y;                              // 1 & y = y
+                if (isConst(y, 1)) return x;
+                if (x == y) return x;                                     // x & x = x
+                if (isNegation(x, y)) return constant(0);                 // x & !x = 0
+                break;
+            case OP_OR:
+                if (isConst(x, 1) || isConst(y, 1)) return constant(1);   // x | 1 = 1
+                if (isConst(x, 0)) return y;                              // 0 | y = y
+                if (isConst(y, 0)) return x;
+                if (x == y) return x;                                     // x | x = x
+                if (isNegation(x, y)) return constant(1);                 // x | !x = 1
+                break;
+            case OP_XOR:
+                if (isConst(x, 0)) return y;                              // 0 ^ y = y
+                if (isConst(y, 0)) return x;
+                if (isConst(x, 1)) return makeNot(y);                     // 1 ^ y = !y
+                if (isConst(y, 1)) return makeNot(x);
+                if (x == y) return constant(0);                           // x ^ x = 0
+                if (isNegation(x, y)) return constant(1);                 // x ^ !x = 1
+                break;
+            default:
+                throw invalid_argument("Неизвестный оператор");
+        }
+        // Более дешёвый операнд вычисляется первым: чаще срабатывает короткое замыкание
+        if (nodes[y].size < nodes[x].size || (nodes[y].size == nodes[x].size && y < x)) swap(x, y);
+        return make(op, x, y);
+    }
+
+    // Построение дерева по постфиксной программе (инструкции переходов пропускаются)
+    unsigned build(const Program& prog) {
+        vector<unsigned> st;
+        for (const Instr& in : prog.code) {
+            switch (in.op) {
+                case OP_CONST: st.push_back(constant(in.arg)); break;
+                case OP_VAR:   st.push_back(variable(in.arg)); break;
+                case OP_NOT:   st.back() = makeNot(st.back()); break;
+                case OP_AND:
+                case OP_OR:
+                case OP_XOR: {
+                    unsigned y = st.back();
+                    st.pop_back();
+                    st.back() = makeBinary(in.op, st.back(), y);
+                    break;
+                }
+                case OP_JF:
+                case OP_JT: break;
+            }
+        }
+        return st.back();
+    }
+
+    // Генерация программы с коротким замыканием: "x; JF end; y; AND; end:"
+    void emit(unsigned root, Program& out) const {
+        struct Frame {
+            unsigned node;
+            int stage;           // 0 — левый операнд, 1 — правый, 2 — сам оператор
+            size_t jump;         // Адрес инструкции перехода для исправления
+        };
+        vector<Frame> frames{{root, 0, 0}};
+        size_t depth = 0;
+        out.code.clear();
+        out.maxDepth = 0;
+
+        while (!frames.empty()) {
+            Frame& f = frames.back();
+            const Node& n = nodes[f.node];
+            if (n.op == OP_CONST || n.op == OP_VAR) {
+                out.code.push_back({n.op, n.a});
+                depth++;
+                if (depth > out.maxDepth) out.maxDepth = depth;
+                frames.pop_back();
+            }
+            else if (f.stage == 0) {
+                f.stage = (n.op == OP_NOT) ? 2 : 1;
+                frames.push_back({n.a, 0, 0});
+            }
+            else if (f.stage == 1) {
+                f.stage = 2;
+                if (n.op == OP_AND || n.op == OP_OR) {
+                    f.jump = out.code.size();
+                    out.code.push_back({n.op == OP_AND ? OP_JF : OP_JT, 0});
+                }
+                frames.push_back({n.b, 0, 0});
+            }
+            else {
+                out.code.push_back({n.op, 0});
+                if (n.op != OP_NOT) depth--;
+                if (n.op == OP_AND || n.op == OP_OR) {
+                    out.code[f.jump].arg = (unsigned)out.code.size();  // Сразу за оператором
+                }
+                frames.pop_back();
+            }
+        }
+    }
+};
+
+// Оптимизация программы: свёртка констант, тождества (x & 0, x | 1, !!x, x ^ x ...),
+// удаление мёртвых подвыражений и короткое замыкание & и | при вычислении.
+// Переменные, исчезнувшие из выражения (a в "a | 1"), удаляются из таблицы,
+// остальные сохраняют взаимный порядок и получают новые индексы
+Program optimize(const Program& prog) {
+    ExprOptimizer optimizer;
+    unsigned root = optimizer.build(prog);
+    Program out;
+    optimizer.emit(root, out);
+
+    vector<int> remap(prog.vars.size(), -1);
+    for (const Instr& in : out.code) {
+        if (in.op == OP_VAR) remap[in.arg] = 0;
+    }
+    for (size_t i = 0; i < prog.vars.size(); i++) {
+        if (remap[i] < 0) continue;
+        remap[i] = (int)out.vars.size();
+        out.vars.push_back(prog.vars[i]);
+    }
+    for (Instr& in : out.code) {
+        if (in.op == OP_VAR) in.arg = (unsigned)remap[in.arg];
+    }
+    return out;
+}
+
+
+// ---------- Инкрементальное перевычисление ----------
+
+// Граф выражения с запомненными значениями узлов. При изменении одной переменной
+// пересчитываются только узлы на путях от неё к корню, и распространение
+// останавливается там, где значение узла не изменилось
+class IncrementalEvaluator {
+private:
+    struct Node {
+        OpCode op;
+        unsigned a, b;               // Константа / индекс переменной / номера потомков
+        unsigned char value;         // Текущее значение узла
+    };
+    vector<Node> nodes;              // Потомки всегда имеют меньший номер, чем родитель
+    vector<vector<unsigned>> parents;        // Родители каждого узла
+    vector<unsigned> varNode;                // Узел переменной по её индексу
+    vector<unsigned char> values;            // Текущие значения переменных
+    vector<unsigned char> queued;            // Узел уже стоит в очереди пересчёта
+    vector<unsigned> heap;                   // Очередь пересчёта: min-куча номеров узлов
+    unsigned root = 0;
+
+    unsigned char compute(const Node& n) const {
+        switch (n.op) {
+            case OP_CONST: return (unsigned char)n.a;
+            case OP_VAR:   return values[n.a];
+            case OP_NOT:   return nodes[n.a].value ^ 1;
+            case OP_AND:   return nodes[n.a].value & nodes[n.b].value;
+            case OP_OR:    return nodes[n.a].value | nodes[n.b].value;
+            case OP_XOR:   return nodes[n.a].value ^ nodes[n.b].value;
+            default:       return 0;
+        }
+    }
+
+    unsigned addNode(OpCode op, unsigned a, unsigned b) {
+        nodes.push_back({op, a, b, 0});
+        parents.emplace_back();
+        unsigned id = (unsigned)nodes.size() - 1;
+        if (op == OP_NOT) parents[a].push_back(id);
+        else if (op != OP_CONST && op != OP_VAR) {
+            parents[a].push_back(id);
+            if (b != a) parents[b].push_back(id);
+        }
+        nodes[id].value = compute(nodes[id]);
+        return id;
+    }
+
+public:
+    // Построение графа и полное вычисление при начальных значениях переменных
+    IncrementalEvaluator(const Program& prog, const vector<int>& initial) {
+        if (initial.size() < prog.vars.size()) {
+            throw invalid_argument("Заданы значения не всех переменных");
+        }
+        values.resize(prog.vars.size());
+        for (size_t i = 0; i < values.size(); i++) values[i] = initial[i] != 0;
+        varNode.assign(prog.vars.size(), UINT32_MAX);
+
+        vector<unsigned> st;
+        for (const Instr& in : prog.code) {
+            switch (in.op) {
+                case OP_CONST: st.push_back(addNode(OP_CONST, in.arg, 0)); break;
+                case OP_VAR:                              // Одна вершина на переменную
+                    if (varNode[in.arg] == UINT32_MAX) varNode[in.arg] = addNode(OP_VAR, in.arg, 0);
+                    st.push_back(varNode[in.arg]);
+                    break;
+                case OP_NOT: st.back() = addNode(OP_NOT, st.back(), 0); break;
+                case OP_AND:
+                case OP_OR:
+                case OP_XOR: {
+                    unsigned y = st.back();
+                    st.pop_back();
+                    st.back() = addNode(in.op, st.back(), y);
+                    break;
+                }
+                case OP_JF:
+                case OP_JT: break;
+            }
+        }
+        root = st.back();
+        queued.assign(nodes.size(), 0);
+    }
+
+    // Текущее значение всего выражения
+    int result() const { return nodes[root].value; }
+
+    // Изменение значения переменной с пересчётом только затронутых узлов
+    int set(unsigned var, int value) {
+        if (var >= values.size()) throw out_of_range("Нет переменной с таким индексом");
+        unsigned char v = value != 0;
+        if (values[var] == v) return result();
+        values[var] = v;
+        if (varNode[var] == UINT32_MAX) return result(); // Переменная не участвует в выражении
+
+        nodes[varNode[var]].value = v;
+        auto later = greater<unsigned>();
+        for (unsigned p : parents[varNode[var]]) {
+            if (!queued[p]) { queued[p] = 1; heap.push_back(p); push_heap(heap.begin(), heap.end(), later); }
+        }
+        // Узлы пересчитываются по возрастанию номеров, т.е. после всех своих потомков
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), later);
+            unsigned id = heap.back();
+            heap.pop_back();
+            queued[id] = 0;
+            unsigned char updated = compute(nodes[id]);
+            if (updated == nodes[id].value) continue;     // Дальше изменение не распространяется
+            nodes[id].value = updated;
+            for (unsigned p : parents[id]) {
+                if (!queued[p]) { queued[p] = 1; heap.push_back(p); push_heap(heap.begin(), heap.end(), later); }
+            }
+        }
+        return result();
+    }
+
+    // Инвертирование переменной
+    int flip(unsigned var) {
+        if (var >= values.size()) throw out_of_range("Нет переменной с таким индексом");
+        return set(var, !values[var]);
+    }
+};
+
+
+// ---------- Вычисление на этапе компиляции ----------
+
+// Узел дерева выражения, пригодного для constexpr-вычислений
+struct ConstNode {
+    OpCode op = OP_CONST;
+    unsigned a = 0, b = 0;           // Константа / индекс переменной / номера потомков
+};
+
+// Дерево выражения фиксированной ёмкости N; потомки всегда имеют меньший номер
+template <size_t N>
+struct ConstTree {
+    ConstNode nodes[N] = {};
+    size_t count = 0;
+    unsigned root = 0;
+    string_view vars[N] = {};        // Имена переменных в порядке первого появления
+    size_t varCount = 0;
+};
+
+constexpr bool isIdentStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool isIdentChar(char c) { return isIdentStart(c) || (c >= '0' && c <= '9'); }
+
+// Добавление узла с немедленной свёрткой константных операндов
+template <size_t N>
+constexpr unsigned addConstNode(ConstTree<N>& tree, OpCode op, unsigned a, unsigned b) {
+    const ConstNode& x = tree.nodes[a];
+    const ConstNode& y = tree.nodes[b];
+    if (op == OP_NOT && x.op == OP_CONST) {
+        op = OP_CONST;
+        a = !x.a;
+    } else if (op != OP_CONST && op != OP_VAR && op != OP_NOT && x.op == OP_CONST && y.op == OP_CONST) {
+        a = op == OP_AND ? (x.a & y.a) : op == OP_OR ? (x.a | y.a) : (x.a ^ y.a);
+        op = OP_CONST;
+    }
+    if (tree.count == N) throw overflow_error("Слишком длинное выражение");
+    tree.nodes[tree.count] = ConstNode{op, a, b};
+    return (unsigned)tree.count++;
+}
+
+// Применяет оператор с вершины стека операторов к стеку узлов
+template <size_t N>
+constexpr void reduceConst(ConstTree<N>& tree, unsigned* values, size_t& vtop, char* ops, size_t& otop) {
+    char op = ops[--otop];
+    if (vtop < (op == '!' ? 1u : 2u)) throw invalid_argument("Некорректное выражение: не хватает операнда");
+    if (op == '!') {
+        values[vtop - 1] = addConstNode(tree, OP_NOT, values[vtop - 1], values[vtop - 1]);
+        return;
+    }
+    unsigned y = values[--vtop];
+    OpCode code = op == '&' ? OP_AND : op == '|' ? OP_OR : OP_XOR;
+    values[vtop - 1] = addConstNode(tree, code, values[vtop - 1], y);
+}
+
+// Разбор выражения в дерево на этапе компиляции (тот же синтаксис, что у compile).
+// N — ёмкость дерева; длины выражения плюс один всегда достаточно
+template <size_t N>
+constexpr ConstTree<N> parseConst(string_view expr) {
+    ConstTree<N> tree;
+    unsigned values[N] = {};
+    char ops[N] = {};
+    size_t vtop = 0, otop = 0;
+    bool afterOperand = false;       // Предыдущий токен — операнд или ')'
+
+    for (size_t i = 0; i < expr.size(); i++) {
+        char c = expr[i];
+        if (c == ' ' || c == '\t') continue;
+        if (vtop == N || otop == N) throw overflow_error("Слишком длинное выражение");
+        if (c == '!' && afterOperand) throw invalid_argument("Оператор ! допустим только перед операндом");
+        afterOperand = c == '0' || c == '1' || c == ')' || isIdentStart(c);
+
+        if (c == '0' || c == '1') {
+            values[vtop++] = addConstNode(tree, OP_CONST, (unsigned)(c - '0'), 0);
+        }
+        else if (isIdentStart(c)) {
+            size_t start = i;
+            while (i + 1 < expr.size() && isIdentChar(expr[i + 1])) i++;
+            string_view name = expr.substr(start, i - start + 1);
+            size_t idx = 0;
+            while (idx < tree.varCount && tree.vars[idx] != name) idx++;
+            if (idx == tree.varCount) tree.vars[tree.varCount++] = name;
+            values[vtop++] = addConstNode(tree, OP_VAR, (unsigned)idx, 0);
+        }
+        else if (c == '(' || c == '!') {
+            ops[otop++] = c;
+        }
+        else if (c == ')') {
+            while (otop > 0 && ops[otop - 1] != '(') reduceConst(tree, values, vtop, ops, otop);
+            if (otop == 0) throw invalid_argument("Лишняя закрывающая скобка");
+            otop--;
+        }
+        else if (c == '&' || c == '|' || c == '^') {
+            while (otop > 0 && ops[otop - 1] != '(' && priority(ops[otop - 1]) >= priority(c)) {
+                reduceConst(tree, values, vtop, ops, otop);
+            }
+            ops[otop++] = c;
+        }
+        else {
+            throw invalid_argument("Неизвестный символ");
+        }
+    }
+    while (otop > 0) {
+        if (ops[otop - 1] == '(') throw invalid_argument("Незакрытая скобка");
+        reduceConst(tree, values, vtop, ops, otop);
+    }
+    if (vtop != 1) throw invalid_argument("Некорректное выражение");
+    tree.root = values[0];
+    return tree;
+}
+
+// Вычисление дерева; бит i в vars — значение i-й переменной
+template <size_t N>
+constexpr int evaluateTree(const ConstTree<N>& tree, uint64_t vars) {
+    unsigned char value[N] = {};
+    for (size_t i = 0; i < tree.count; i++) {   // Потомки вычислены раньше родителей
+        const ConstNode& n = tree.nodes[i];
+        switch (n.op) {
+            case OP_CONST: value[i] = (unsigned char)n.a; break;
+            case OP_VAR:   value[i] = (vars >> n.a) & 1; break;
+            case OP_NOT:   value[i] = value[n.a] ^ 1; break;
+            case OP_AND:   value[i] = value[n.a] & value[n.b]; break;
+            case OP_OR:    value[i] = value[n.a] | value[n.b]; break;
+            default:       value[i] = value[n.a] ^ value[n.b]; break;
+        }
+    }
+    return value[tree.root];
+}
+
+// Максимальная длина выражения для evaluateConst
+const size_t CONST_MAX_LENGTH = 256;
+
+// Вычисление выражения, пригодное для constexpr-контекста:
+// static_assert(evaluateConst("!(1 & 0)") == 1);
+constexpr int evaluateConst(string_view expr, uint64_t vars = 0) {
+    return evaluateTree(parseConst<CONST_MAX_LENGTH + 1>(expr), vars);
+}
+
+// Формула, разобранная при компиляции и развёрнутая в линейный код без стековой машины.
+// Formula — тип со строкой формулы:
+//   struct Rule { static constexpr string_view text = "a & !b | c"; };
+//   int r = StaticExpr<Rule>::eval(mask);   // бит i mask — значение i-й переменной
+template <typename Formula>
+struct StaticExpr {
+    static constexpr auto tree = parseConst<Formula::text.size() + 1>(Formula::text);
+
+    // Значение узла Id; каждый узел разворачивается в отдельную инлайн-функцию
+    template <unsigned Id>
+    static constexpr int node(uint64_t vars) {
+        constexpr ConstNode n = tree.nodes[Id];
+        if constexpr (n.op == OP_CONST) return (int)n.a;
+        else if constexpr (n.op == OP_VAR) return (int)((vars >> n.a) & 1);
+        else if constexpr (n.op == OP_NOT) return node<n.a>(vars) ^ 1;
+        else if constexpr (n.op == OP_AND) return node<n.a>(vars) & node<n.b>(vars);
+        else if constexpr (n.op == OP_OR) return node<n.a>(vars) | node<n.b>(vars);
+        else return node<n.a>(vars) ^ node<n.b>(vars);
+    }
+
+    static constexpr size_t varCount() { return tree.varCount; }
+
+    static constexpr int eval(uint64_t vars = 0) { return node<tree.root>(vars); }
+};
+
+
+// ---------- Каноническая форма: упорядоченные диаграммы решений (BDD) ----------
+
+// Общее хранилище BDD для множества правил. Каждая вершина (переменная, низ, верх)
+// создаётся один раз, поэтому одинаковые подвыражения разных правил хранятся
+// однократно, а эквивалентные выражения получают один и тот же номер корня
+class BddManager {
+private:
+    struct Node {
+        unsigned var;        // Индекс переменной (TERMINAL_VAR у листьев 0 и 1)
+        unsigned lo, hi;     // Переходы при значении переменной 0 и 1
+    };
+    struct Key {
+        unsigned a, b, c;
+        bool operator==(const Key& o) const { return a == o.a && b == o.b && c == o.c; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.a * 0x9E3779B97F4A7C15ULL;
+            h ^= (h >> 29) + k.b * 0xBF58476D1CE4E5B9ULL;
+            h ^= (h >> 31) + k.c * 0x94D049BB133111EBULL;
+            return (size_t)(h ^ (h >> 32));
+        }
+    };
+    static const unsigned TERMINAL_VAR = UINT32_MAX;
+
+    vector<Node> nodes;                          // 0 — ложь, 1 — истина
+    unordered_map<Key, unsigned, KeyHash> unique;    // (var, lo, hi) -> вершина
+    unordered_map<Key, unsigned, KeyHash> cache;     // (операция, f, g) -> результат
+    vector<string> names;                        // Глобальный порядок переменных
+    unordered_map<string, unsigned> nameIndex;
+
+    unsigned mk(unsigned var, unsigned lo, unsigned hi) {
+        if (lo == hi) return lo;                 // Вершина не зависит от переменной
+        Key key{var, lo, hi};
+        auto it = unique.find(key);
+        if (it != unique.end()) return it->second;
+        nodes.push_back({var, lo, hi});
+        unique.emplace(key, (unsigned)nodes.size() - 1);
+        return (unsigned)nodes.size() - 1;
+    }
+
+    unsigned apply(OpCode op, unsigned f, unsigned g) {
+        switch (op) {                            // Случаи, решаемые без рекурсии
+            case OP_AND:
+                if (f == 0 || g == 0) return 0;
+                if (f == 1) return g;
+                if (g == 1 || f == g) return f;
+                break;
+            case OP_OR:
+                if (f == 1 || g == 1) return 1;
+                if (f == 0) return g;
+                if (g == 0 || f == g) return f;
+                break;
+            case OP_XOR:
+                if (f == g) return 0;
+                if (f == 0) return g;
+                if (g == 0) return f;
+                if (f <= 1 && g <= 1) return f ^ g;
+                break;
+            default:
+                throw invalid_argument("Неизвестный оператор");
+        }
+        if (g < f) swap(f, g);                   // Все операции коммутативны
+        Key key{(unsigned)op, f, g};
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+
+        const Node nf = nodes[f], ng = nodes[g];
+        unsigned var = nf.var < ng.var ? nf.var : ng.var;
+        unsigned flo = nf.var == var ? nf.lo : f, fhi = nf.var == var ? nf.hi : f;
+        unsigned glo = ng.var == var ? ng.lo : g, ghi = ng.var == var ? ng.hi : g;
+        unsigned lo = apply(op, flo, glo);
+        unsigned hi = apply(op, fhi, ghi);
+        unsigned r = mk(var, lo, hi);
+        cache.emplace(key, r);
+        return r;
+    }
+
+public:
+    BddManager() {
+        nodes.push_back({TERMINAL_VAR, 0, 0});   // Лист «ложь»
+        nodes.push_back({TERMINAL_VAR, 1, 1});   // Лист «истина»
+    }
+
+    // Глобальный индекс переменной (создаётся при первом обращении)
+    unsigned varIndex(const string& name) {
+        auto it = nameIndex.find(name);
+        if (it != nameIndex.end()) return it->second;
+        names.push_back(name);
+        nameIndex.emplace(name, (unsigned)names.size() - 1);
+        return (unsigned)names.size() - 1;
+    }
+
+    const vector<string>& variables() const { return names; }
+
+    unsigned constant(int value) const { return value ? 1 : 0; }
+
+    unsigned variable(const string& name) { return mk(varIndex(name), 0, 1); }
+
+    unsigned makeNot(unsigned f) { return apply(OP_XOR, f, 1); }
+
+    unsigned makeAnd(unsigned f, unsigned g) { return apply(OP_AND, f, g); }
+
+    unsigned makeOr(unsigned f, unsigned g) { return apply(OP_OR, f, g); }
+
+    unsigned makeXor(unsigned f, unsigned g) { return apply(OP_XOR, f, g); }
+
+    // Построение BDD по скомпилированной программе; возвращает номер корня
+    unsigned build(const Program& prog) {
+        vector<unsigned> varRoot(prog.vars.size());
+        for (size_t i = 0; i < prog.vars.size(); i++) varRoot[i] = variable(prog.vars[i]);
+
+        vector<unsigned> st;
+        for (const Instr& in : prog.code) {
+            switch (in.op) {
+                case OP_CONST: st.push_back(constant(in.arg)); break;
+                case OP_VAR:   st.push_back(varRoot[in.arg]); break;
+                case OP_NOT:   st.back() = makeNot(st.back()); break;
+                case OP_AND:
+                case OP_OR:
+                case OP_XOR: {
+                    unsigned g = st.back();
+                    st.pop_back();
+                    st.back() = apply(in.op, st.back(), g);
+                    break;
+                }
+                case OP_JF:
+                case OP_JT: break;
+            }
+        }
+        return st.back();
+    }
+
+    unsigned build(const string& expr) { return build(compile(expr)); }
+
+    // Эквивалентность выражений без перебора таблицы истинности
+    bool equivalent(unsigned f, unsigned g) const { return f == g; }
+
+    // Значение выражения; values[i] — значение переменной variables()[i]
+    int evaluate(unsigned f, const vector<int>& values) const {
+        while (f > 1) {
+            const Node& n = nodes[f];
+            if (n.var >= values.size()) throw invalid_argument("Заданы значения не всех переменных");
+            f = values[n.var] ? n.hi : n.lo;
+        }
+        return (int)f;
+    }
+
+    // Значения набора правил; правила с одинаковым корнем вычисляются один раз
+    vector<int> evaluateAll(const vector<unsigned>& roots, const vector<int>& values) const {
+        vector<int> results(roots.size());
+        unordered_map<unsigned, int> memo;
+        for (size_t i = 0; i < roots.size(); i++) {
+            auto it = memo.find(roots[i]);
+            if (it == memo.end()) it = memo.emplace(roots[i], evaluate(roots[i], values)).first;
+            results[i] = it->second;
+        }
+        return results;
+    }
+
+    // Общее число вершин во всех диаграммах (включая два листа)
+    size_t nodeCount() const { return nodes.size(); }
+
+    // Очистка кэша операций (вершины сохраняются)
+    void clearCache() { cache.clear(); }
+};
+
+
+// ---------- Замер производительности ----------
+
+// Случайное выражение примерно из tokens токенов с глубиной скобок не больше 2,
+// чтобы его мог вычислить и исходный evaluate со стеком на 30 элементов
+static string randomExpression(size_t tokens, mt19937& rng) {
+    const char binOps[] = {'&', '|', '^'};
+    string expr;
+    size_t count = 0;
+    while (true) {
+        if (rng() % 4 == 0) { expr += '!'; count++; }
+        if (rng() % 5 == 0) {                         // Короткая подгруппа в скобках
+            expr += '(';
+            expr += (char)('0' + rng() % 2);
+            expr += binOps[rng() % 3];
+            expr += (char)('0' + rng() % 2);
+            expr += ')';
+            count += 5;
+        } else {
+            expr += (char)('0' + rng() % 2);
+            count++;
+        }
+        if (count >= tokens) break;
+        expr += binOps[rng() % 3];
+        count++;
+    }
+    return expr;
+}
+
+// Случайное выражение над переменными a, b, c, ... (vars штук) и константами
+static string randomFormula(size_t operands, unsigned vars, mt19937& rng) {
+    const char binOps[] = {'&', '|', '^'};
+    string expr;
+    size_t open = 0;
+    for (size_t k = 0; k < operands; k++) {
+        if (rng() % 4 == 0) expr += '!';
+        if (rng() % 4 == 0) { expr += '('; open++; }
+        if (rng() % 6 == 0) expr += (char)('0' + rng() % 2);
+        else expr += (char)('a' + rng() % vars);
+        if (open > 0 && rng() % 3 == 0) { expr += ')'; open--; }
+        if (k + 1 < operands) expr += binOps[rng() % 3];
+    }
+    expr.append(open, ')');
+    return expr;
+}
+
+// Значение набора i в упакованном результате (таблица истинности, evaluateBatch)
+static inline int bitAt(const vector<uint64_t>& bits, uint64_t i) {
+    return (int)((bits[i >> 6] >> (i & 63)) & 1);
+}
+
+// Сравнение скорости evaluate(string), evaluateFast и compile + evaluate(Program);
+// затем побитово-параллельного вычисления с evaluate по одному набору
+void runBenchmark() {
+    mt19937 rng(12345);
+    cout << "токенов      evaluate, ток/с   evaluateFast, ток/с   compile+run, ток/с" << endl;
+    for (size_t tokens = 1000; tokens <= 1000000; tokens *= 10) {
+        string expr = randomExpression(tokens, rng);
+        size_t repeats = 2000000 / tokens + 1;
+        double rates[3];
+        int results[3] = {-1, -1, -1};
+
+        for (int mode = 0; mode < 3; mode++) {
+            auto start = chrono::steady_clock::now();
+            for (size_t r = 0; r < repeats; r++) {
+                if (mode == 0) results[mode] = evaluate(expr);
+                else if (mode == 1) results[mode] = evaluateFast(expr);
+                else results[mode] = evaluate(compile(expr), vector<int>());
+            }
+            double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            rates[mode] = (double)tokens * repeats / sec;
+        }
+        if (results[0] != results[1] || results[1] != results[2]) {
+            cerr << "Расхождение результатов на " << tokens << " токенах" << endl;
+        }
+        printf("%-10zu %18.3e %21.3e %20.3e\n", tokens, rates[0], rates[1], rates[2]);
+    }
+
+    // Все 2^20 наборов значений 20 переменных: по одному через evaluate, таблицей
+    // истинности и evaluateBatch по столбцам (те же наборы в том же порядке)
+    Program prog = compile(randomFormula(200, 20, rng));
+    size_t n = prog.vars.size();
+    uint64_t sets = 1ULL << n;
+    vector<int> values(n);
+    vector<int> single(sets);
+    auto start = chrono::steady_clock::now();
+    for (uint64_t mask = 0; mask < sets; mask++) {
+        for (size_t i = 0; i < n; i++) values[i] = (mask >> i) & 1;
+        single[mask] = evaluate(prog, values);
+    }
+    double singleSec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    vector<uint64_t> table = truthTable(prog);
+    double tableSec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<vector<uint64_t>> columns(n, vector<uint64_t>(table.size()));
+    for (size_t v = 0; v < n; v++) {
+        for (size_t k = 0; k < table.size(); k++) columns[v][k] = truthWord((unsigned)v, k);
+    }
+    start = chrono::steady_clock::now();
+    vector<uint64_t> batch = evaluateBatch(prog, columns);
+    double batchSec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (uint64_t mask = 0; mask < sets; mask++) {
+        if (bitAt(table, mask) != single[mask] || bitAt(batch, mask) != single[mask]) {
+            cerr << "Расхождение результатов на наборе " << mask << endl;
+            break;
+        }
+    }
+    cout << endl << "наборов      evaluate, наб/с   truthTable, наб/с   evaluateBatch, наб/с" << endl;
+    printf("%-10llu %18.3e %19.3e %22.3e\n", (unsigned long long)sets,
+           sets / singleSec, sets / tableSec, sets / batchSec);
+
+    // Выигрыш optimize: evaluate исходной и оптимизированной программы на всех
+    // 2^12 наборах, по 20 случайным формулам из 200 операндов с константами
+    const int FORMULAS = 20;
+    size_t codeBefore = 0, codeAfter = 0;
+    double rawSec = 0, optSec = 0;
+    uint64_t evaluated = 0;
+    for (int f = 0; f < FORMULAS; f++) {
+        Program raw = compile(randomFormula(200, 12, rng));
+        Program opt = optimize(raw);
+        codeBefore += raw.code.size();
+        codeAfter += opt.code.size();
+        vector<int> rawValues(raw.vars.size()), optValues(opt.vars.size()), source(opt.vars.size());
+        for (size_t j = 0; j < source.size(); j++) source[j] = findVar(raw, opt.vars[j]);
+        uint64_t count = 1ULL << raw.vars.size();
+        vector<int> results(count);
+        start = chrono::steady_clock::now();
+        for (uint64_t mask = 0; mask < count; mask++) {
+            for (size_t i = 0; i < rawValues.size(); i++) rawValues[i] = (mask >> i) & 1;
+            results[mask] = evaluate(raw, rawValues);
+        }
+        rawSec += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        size_t mismatches = 0;
+        start = chrono::steady_clock::now();
+        for (uint64_t mask = 0; mask < count; mask++) {
+            for (size_t j = 0; j < optValues.size(); j++) optValues[j] = (mask >> source[j]) & 1;
+            mismatches += evaluate(opt, optValues) != results[mask];
+        }
+        optSec += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (mismatches > 0) cerr << "Расхождение optimize на формуле " << f << endl;
+        evaluated += count;
+    }
+    cout << endl << "формул   инструкций до   после   evaluate, наб/с   после optimize, наб/с" << endl;
+    printf("%-8d %15zu %7zu %17.3e %23.3e\n", FORMULAS, codeBefore, codeAfter,
+           evaluated / rawSec, evaluated / optSec);
+}
+
+
+// ---------- Самопроверка ----------
+
+// Формулы, развёрнутые StaticExpr при компиляции
+struct CheckRuleAlarm { static constexpr string_view text = "a & !b | c"; };
+struct CheckRuleParity { static constexpr string_view text = "!(a ^ b) & (c | !d) ^ e"; };
+struct CheckRuleFolded { static constexpr string_view text = "(x | 1) & !(0 ^ y) | x & z"; };
+
+// Сравнение StaticExpr<Rule> с evaluate(compile(...)) на всех наборах значений.
+// Переменные в обоих случаях нумеруются в порядке первого появления
+template <typename Rule>
+static size_t checkStaticExpr() {
+    Program prog = compile(string(Rule::text));
+    if (prog.vars.size() != StaticExpr<Rule>::varCount()) return 1;
+    size_t errors = 0;
+    vector<int> values(prog.vars.size());
+    for (uint64_t mask = 0; mask < (1ULL << values.size()); mask++) {
+        for (size_t i = 0; i < values.size(); i++) values[i] = (mask >> i) & 1;
+        if (StaticExpr<Rule>::eval(mask) != evaluate(prog, values)) errors++;
+    }
+    return errors;
+}
+
+// Проверка вспомогательных вычислителей против evaluate(compile(...)) на случайных
+// выражениях; печатает результат по каждой части, возвращает число расхождений
+int runSelfCheck() {
+    mt19937 rng(2024);
+    size_t failures = 0;
+
+    // Инкрементальный пересчёт: после каждого изменения переменной
+    size_t incrementalErrors = 0;
+    for (int t = 0; t < 200; t++) {
+        Program prog = compile(randomFormula(2 + rng() % 40, 6, rng));
+        vector<int> values(prog.vars.size(), 0);
+        IncrementalEvaluator incremental(prog, values);
+        for (int step = 0; step < 100 && !values.empty(); step++) {
+            unsigned var = rng() % values.size();
+            values[var] = (int)(rng() % 2);
+            if (incremental.set(var, values[var]) != evaluate(prog, values)) incrementalErrors++;
+        }
+    }
+    cout << "IncrementalEvaluator: " << (incrementalErrors == 0 ? "OK" : "ОШИБКИ: " + to_string(incrementalErrors)) << endl;
+    failures += incrementalErrors;
+
+    // Разбор для constexpr: тот же результат, что у compile, и те же синтаксические ошибки
+    size_t constErrors = checkStaticExpr<CheckRuleAlarm>() + checkStaticExpr<CheckRuleParity>() +
+                         checkStaticExpr<CheckRuleFolded>();
+    for (int t = 0; t < 300; t++) {
+        string expr = randomFormula(1 + rng() % 30, 6, rng);
+        Program prog = compile(expr);
+        vector<int> values(prog.vars.size());
+        for (uint64_t mask = 0; mask < (1ULL << values.size()); mask++) {
+            for (size_t i = 0; i < values.size(); i++) values[i] = (mask >> i) & 1;
+            if (evaluateConst(expr, mask) != evaluate(prog, values)) constErrors++;
+        }
+    }
+    for (const char* bad : {"1!", "a & b!", "(0)!", "1 &", "(1"}) {
+        try {
+            evaluateConst(bad);
+            constErrors++;
+        } catch (const exception&) {
+        }
+    }
+    cout << "evaluateConst / StaticExpr: " << (constErrors == 0 ? "OK" : "ОШИБКИ: " + to_string(constErrors)) << endl;
+    failures += constErrors;
+
+    // BDD: совпадение корней — ровно совпадение значений на всех 2^5 наборах
+    size_t bddErrors = 0;
+    BddManager bdd;
+    vector<unsigned> roots;
+    vector<uint32_t> tables;                          // Бит mask — значение при наборе mask
+    for (int t = 0; t < 400; t++) {
+        Program prog = compile(randomFormula(1 + rng() % 8, 5, rng));
+        unsigned root = bdd.build(prog);
+        uint32_t table = 0;
+        for (unsigned mask = 0; mask < 32; mask++) {
+            vector<int> values(prog.vars.size());
+            for (size_t i = 0; i < values.size(); i++) values[i] = (mask >> (prog.vars[i][0] - 'a')) & 1;
+            vector<int> global(bdd.variables().size());
+            for (size_t i = 0; i < global.size(); i++) global[i] = (mask >> (bdd.variables()[i][0] - 'a')) & 1;
+            int value = evaluate(prog, values);
+            if (bdd.evaluate(root, global) != value) bddErrors++;
+            table |= (uint32_t)value << mask;
+        }
+        for (size_t k = 0; k < roots.size(); k++) {
+            if (bdd.equivalent(root, roots[k]) != (table == tables[k])) bddErrors++;
+        }
+        roots.push_back(root);
+        tables.push_back(table);
+    }
+    cout << "BddManager: " << (bddErrors == 0 ? "OK" : "ОШИБКИ: " + to_string(bddErrors)) << endl;
+    failures += bddErrors;
+
+    // Таблица истинности и пакетное вычисление: каждый бит совпадает с evaluate на
+    // своём наборе. До 10 переменных — и полосы по 256 наборов, и хвост по 64
+    size_t batchErrors = 0;
+    for (int t = 0; t < 200; t++) {
+        Program prog = compile(randomFormula(1 + rng() % 40, 10, rng));
+        size_t n = prog.vars.size();
+        vector<int> values(n);
+        vector<uint64_t> table = truthTable(prog);
+        for (uint64_t mask = 0; mask < (1ULL << n); mask++) {
+            for (size_t i = 0; i < n; i++) values[i] = (mask >> i) & 1;
+            if (bitAt(table, mask) != evaluate(prog, values)) batchErrors++;
+        }
+        if (n < 6 && (table[0] >> (1u << n)) != 0) batchErrors++;   // Лишние биты обнулены
+
+        vector<vector<uint64_t>> columns(n, vector<uint64_t>(1 + rng() % 9));
+        for (vector<uint64_t>& column : columns) {
+            for (uint64_t& word : column) word = ((uint64_t)rng() << 32) | rng();
+        }
+        vector<uint64_t> batch = evaluateBatch(prog, columns);
+        for (uint64_t r = 0; r < batch.size() * 64; r++) {
+            for (size_t i = 0; i < n; i++) values[i] = bitAt(columns[i], r);
+            if (bitAt(batch, r) != evaluate(prog, values)) batchErrors++;
+        }
+    }
+    cout << "truthTable / evaluateBatch: " << (batchErrors == 0 ? "OK" : "ОШИБКИ: " + to_string(batchErrors)) << endl;
+    failures += batchErrors;
+
+    // Оптимизатор: на каждом наборе тот же результат, что у исходной программы.
+    // optimize удаляет исчезнувшие переменные и перенумеровывает остальные,
+    // поэтому значения переносятся по имени. evaluateBatch проверяет переходы
+    // короткого замыкания, которые выполняются только на решённых полосах
+    size_t optimizeErrors = 0;
+    for (int t = 0; t < 300; t++) {
+        Program prog = compile(randomFormula(1 + rng() % 40, 8, rng));
+        Program opt = optimize(prog);
+        vector<int> source(opt.vars.size());          // Индекс переменной opt в prog
+        bool known = true;
+        for (size_t j = 0; j < opt.vars.size(); j++) {
+            source[j] = findVar(prog, opt.vars[j]);
+            if (source[j] < 0) known = false;
+        }
+        if (!known) {
+            optimizeErrors++;
+            continue;
+        }
+        vector<int> values(prog.vars.size()), optValues(opt.vars.size());
+        for (uint64_t mask = 0; mask < (1ULL << values.size()); mask++) {
+            for (size_t i = 0; i < values.size(); i++) values[i] = (mask >> i) & 1;
+            for (size_t j = 0; j < optValues.size(); j++) optValues[j] = values[source[j]];
+            if (evaluate(opt, optValues) != evaluate(prog, values)) optimizeErrors++;
+        }
+
+        vector<vector<uint64_t>> columns(prog.vars.size(), vector<uint64_t>(1 + rng() % 9));
+        for (vector<uint64_t>& column : columns) {
+            for (uint64_t& word : column) word = rng() % 3 == 0 ? 0 : ((uint64_t)rng() << 32) | rng();
+        }
+        vector<vector<uint64_t>> optColumns(opt.vars.size());
+        for (size_t j = 0; j < optColumns.size(); j++) optColumns[j] = columns[source[j]];
+        vector<uint64_t> batch = evaluateBatch(prog, columns), optBatch = evaluateBatch(opt, optColumns);
+        for (uint64_t r = 0; r < batch.size() * 64; r++) {
+            if (bitAt(optBatch, optColumns.empty() ? r % 64 : r) != bitAt(batch, r)) optimizeErrors++;
+        }
+    }
+    cout << "optimize: " << (optimizeErrors == 0 ? "OK" : "ОШИБКИ: " + to_string(optimizeErrors)) << endl;
+    failures += optimizeErrors;
+
+    return (int)failures;
+}
+
+
+// ---------- Наблюдение за выражением ----------
+
+// Режим наблюдения: первая строка ввода — выражение, далее строки "имя значение".
+// Все переменные вначале равны 0; после каждого изменения печатается значение
+// выражения, причём пересчитываются только узлы, зависящие от изменённой переменной
+int runWatch() {
+    string expr;
+    if (!getline(cin, expr)) {
+        return 1;
+    }
+    try {
+        Program prog = compile(expr);
+        IncrementalEvaluator evaluator(prog, vector<int>(prog.vars.size(), 0));
+        cout << evaluator.result() << endl;
+        string name;
+        int value;
+        while (cin >> name >> value) {
+            int idx = findVar(prog, name);
+            if (idx < 0) {
+                cerr << "Ошибка: нет переменной " << name << endl;
+                continue;
+            }
+            cout << evaluator.set((unsigned)idx, value) << '\n';
+        }
+        cout.flush();
+    } catch (const exception& e) {
+        cerr << "Ошибка: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// ---------- Пакетная обработка файлов выражений ----------
+
+// Пул потоков с перехватом работы: у каждого потока своя очередь номеров задач,
+// поток берёт задачи из головы своей очереди, а освободившись — из хвоста чужих
+class WorkStealingPool {
+private:
+    struct Queue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+    vector<unique_ptr<Queue>> queues;
+
+    // Следующая задача для потока self: своя или перехваченная (false, если работы нет)
+    bool nextTask(size_t self, size_t& task) {
+        {
+            Queue& own = *queues[self];
+            lock_guard<mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            Queue& victim = *queues[(self + k) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    // Выполняет fn(i) для всех i из [0, count) на threads потоках
+    template <typename Fn>
+    void run(size_t count, size_t threads, Fn fn) {
+        if (threads == 0) threads = 1;
+        queues.clear();
+        for (size_t t = 0; t < threads; t++) queues.push_back(make_unique<Queue>());
+        for (size_t i = 0; i < count; i++) {          // Соседние задачи — одному потоку
+            queues[i * threads / count]->tasks.push_back(i);
+        }
+
+        vector<thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([this, t, &fn]() {
+                size_t task;
+                while (nextTask(t, task)) fn(task);
+            });
+        }
+        for (thread& w : workers) w.join();
+    }
+};
+
+// Количество строк в одной задаче пакетного режима
+const size_t BATCH_CHUNK_LINES = 4096;
+
+// Чтение потока целиком крупными блоками
+static string readAll(FILE* in) {
+    string data;
+    vector<char> buf(1 << 20);
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), in)) > 0) data.append(buf.data(), n);
+    return data;
+}
+
+// Пакетный режим: по одному выражению в строке, вычисление на всех ядрах,
+// результаты выводятся в порядке входных строк ("-" — стандартный ввод/вывод)
+int runBatch(const string& inputPath, const string& outputPath, size_t threads) {
+    FILE* in = inputPath == "-" ? stdin : fopen(inputPath.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Ошибка открытия файла: " << inputPath << endl;
+        return 1;
+    }
+    string data = readAll(in);
+    if (in != stdin) fclose(in);
+
+    vector<string_view> lines;                        // Строки ссылаются на data без копирования
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == string::npos) end = data.size();
+        lines.emplace_back(data.data() + start, end - start);
+        start = end + 1;
+    }
+
+    size_t chunks = (lines.size() + BATCH_CHUNK_LINES - 1) / BATCH_CHUNK_LINES;
+    vector<string> outputs(chunks);                   // Свой буфер вывода у каждой задачи
+    if (threads == 0) threads = thread::hardware_concurrency();
+
+    WorkStealingPool pool;
+    pool.run(chunks, threads, [&](size_t chunk) {
+        string& out = outputs[chunk];
+        size_t last = std::min(lines.size(), (chunk + 1) * BATCH_CHUNK_LINES);
+        for (size_t i = chunk * BATCH_CHUNK_LINES; i < last; i++) {
+            try {
+                out += (char)('0' + evaluateFast(lines[i]));
+            } catch (const exception& e) {
+                out += "Ошибка: ";
+                out += e.what();
+            }
+            out += '\n';
+        }
+    });
+
+    FILE* out = outputPath.empty() || outputPath == "-" ? stdout : fopen(outputPath.c_str(), "wb");
+    if (out == nullptr) {
+        cerr << "Ошибка открытия файла для записи: " << outputPath << endl;
+        return 1;
+    }
+    for (const string& chunk : outputs) fwrite(chunk.data(), 1, chunk.size(), out);
+    if (out != stdout) fclose(out);
+    else fflush(out);
+    return 0;
+}
+
+// Поиск эквивалентных правил: по одному выражению в строке. Все правила строятся
+// в общем BddManager, поэтому эквивалентность — совпадение корней. Для каждой
+// строки печатается номер первой эквивалентной ей строки (нумерация с 1)
+int runEquivalence(const string& inputPath) {
+    FILE* in = inputPath == "-" ? stdin : fopen(inputPath.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Ошибка открытия файла: " << inputPath << endl;
+        return 1;
+    }
+    string data = readAll(in);
+    if (in != stdin) fclose(in);
+
+    BddManager bdd;
+    unordered_map<unsigned, size_t> firstLine;        // Корень -> первая строка с ним
+    size_t lineNo = 0, rules = 0;
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == string::npos) end = data.size();
+        string line = data.substr(start, end - start);
+        start = end + 1;
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        try {
+            unsigned root = bdd.build(line);
+            rules++;
+            cout << firstLine.emplace(root, lineNo).first->second << '\n';
+        } catch (const exception& e) {
+            cout << "Ошибка: " << e.what() << '\n';
+        }
+    }
+    cout << "Правил: " << rules << ", различных: " << firstLine.size()
+         << ", вершин BDD: " << bdd.nodeCount() << endl;
+    return 0;
+}
+
+
+// ---------- Таблица истинности ----------
+
+// Больше переменных — печатается только число истинных наборов
+const size_t TRUTH_PRINT_VARS = 12;
+
+// Таблица истинности выражения: строка на каждый набор (бит v номера набора —
+// значение переменной v в порядке появления) и число наборов, где выражение истинно
+int runTruthTable(const string& expr) {
+    try {
+        Program prog = compile(expr);
+        vector<uint64_t> table = truthTable(prog);
+        size_t n = prog.vars.size();
+        uint64_t sets = 1ULL << n, ones = 0;
+        for (uint64_t mask = 0; mask < sets; mask++) ones += bitAt(table, mask);
+        if (n <= TRUTH_PRINT_VARS) {
+            for (const string& name : prog.vars) cout << name << " ";
+            cout << "| результат" << endl;
+            for (uint64_t mask = 0; mask < sets; mask++) {
+                for (size_t v = 0; v < n; v++) cout << string(prog.vars[v].size() - 1, ' ') << ((mask >> v) & 1) << " ";
+                cout << "| " << bitAt(table, mask) << endl;
+            }
+        }
+        cout << "Истинно на " << ones << " из " << sets << " наборов" << endl;
+        return 0;
+    } catch (const exception& e) {
+        cerr << "Ошибка: " << e.what() << endl;
+        return 1;
+    }
+}
+
+void printUsage(const char* programName) {
+    cout << "Использование: " << programName << "                      - вычислить одно выражение" << endl;
+    cout << "               " << programName << " --batch <файл|-> [--out <файл>] [--threads N]" << endl;
+    cout << "               " << programName << " --bench" << endl;
+    cout << "               " << programName << " --watch     - выражение, затем строки \"имя значение\"" << endl;
+    cout << "               " << programName << " --equiv <файл|->  - номера эквивалентных правил" << endl;
+    cout << "               " << programName << " --truth <выражение>  - таблица истинности" << endl;
+    cout << "               " << programName << " --selfcheck" << endl;
+}
+
+
+int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "Russian");              
+    if (argc > 1 && string(argv[1]) == "--bench") { // Режим замера производительности
+        runBenchmark();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--selfcheck") {
+        return runSelfCheck() == 0 ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "--watch") {  // Инкрементальный пересчёт
+        return runWatch();
+    }
+    if (argc == 3 && string(argv[1]) == "--equiv") {  // Эквивалентность правил через BDD
+        return runEquivalence(argv[2]);
+    }
+    if (argc == 3 && string(argv[1]) == "--truth") {  // Таблица истинности
+        return runTruthTable(argv[2]);
+    }
+    if (argc > 1) {                                  // Пакетный режим
+        string inputPath, outputPath;
+        size_t threads = 0;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--batch" && i + 1 < argc) inputPath = argv[++i];
+            else if (arg == "--out" && i + 1 < argc) outputPath = argv[++i];
+            else if (arg == "--threads" && i + 1 < argc) {
+                try {
+                    if (argv[++i][0] == '-') throw invalid_argument("отрицательное число");
+                    threads = stoul(argv[i]);
+                } catch (const exception&) {
+                    cerr << "Ошибка: некорректное число потоков: " << argv[i] << endl;
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            }
+            else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        if (inputPath.empty()) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runBatch(inputPath, outputPath, threads);
+    }
+
     string expr;                               
     cout << "Введите логическое выражение: ";
     getline(cin, expr);                         
 
     try {
-        int result = evaluate(expr);            
+        Program prog = optimize(compile(expr));
+        vector<int> values(prog.vars.size());
+        for (size_t i = 0; i < prog.vars.size(); i++) { // Запрашиваем значения переменных
+            cout << "Значение " << prog.vars[i] << ": ";
+            cin >> values[i];
+        }
+        int result = evaluate(prog, values);
         cout << "Результат: " << result << endl; 
     } catch (const exception& e) {
         cerr << "Ошибка: " << e.what() << endl;  
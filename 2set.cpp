@@ -4,9 +4,242 @@
 #include <string>
 #include <vector>
 #include <limits>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 using namespace std;
 
+// Способ хранения элементов множества
+enum SetBackend {
+    BACKEND_LIST,    // Односвязный список: O(n) на поиск
+    BACKEND_HASH,    // Хеш-таблица с открытой адресацией: O(1) в среднем
+    BACKEND_BITMAP,  // Сжатая битовая карта: для плотных диапазонов чисел
+    BACKEND_SORTED   // Отсортированный массив: операции над множествами слиянием
+};
+
+// Общий интерфейс хранилища элементов множества
+class SetStorage {
+public:
+    virtual ~SetStorage() {}
+    virtual SetBackend backend() const = 0;
+    virtual bool insert(int value) = 0;              // false, если элемент уже есть
+    virtual bool erase(int value) = 0;               // false, если элемента нет
+    virtual bool contains(int value) const = 0;
+    virtual int size() const = 0;
+    virtual void clear() = 0;
+    virtual void getElements(vector<int>& elements) const = 0;
+    virtual SetStorage* clone() const = 0;           // Глубокая копия
+    virtual void reserve(size_t) {}                  // Подготовка к вставке n элементов
+
+    // Вставка сразу многих элементов
+    virtual void insertAll(const vector<int>& values) {
+        reserve(size() + values.size());
+        for (int x : values) insert(x);
+    }
+
+    // Вставка элементов, которых в хранилище заведомо нет (и без повторов)
+    virtual void insertDistinct(const vector<int>& values) { insertAll(values); }
+
+    virtual void optimize() {}                       // Сжатие после массовой загрузки
+    virtual size_t memoryBytes() const = 0;          // Оценка занимаемой памяти
+
+    // Сумма элементов без копирования их в вектор
+    virtual long long sum() const {
+        vector<int> elements;
+        getElements(elements);
+        long long total = 0;
+        for (int x : elements) total += x;
+        return total;
+    }
+
+    // Количество элементов меньше value. Все хранилища переопределяют за
+    // O(log n): упорядоченные — по своему порядку, список и хеш — по OrderIndex
+    virtual int rank(int value) const {
+        vector<int> elements;
+        getElements(elements);
+        return (int)count_if(elements.begin(), elements.end(), [value](int x) { return x < value; });
+    }
+
+    // k-й по возрастанию элемент (с нуля), 0 <= k < size()
+    virtual int kth(int k) const {
+        vector<int> elements;
+        getElements(elements);
+        nth_element(elements.begin(), elements.begin() + k, elements.end());
+        return elements[k];
+    }
+};
+
+// Порядковый индекс для хранилищ без порядка (список, хеш-таблица):
+// отсортированные блоки до 2 * ORDER_BLOCK элементов и дерево Фенвика по их
+// размерам. Строится при первом запросе rank/kth за O(n log n), дальше
+// поддерживается при insert/erase за O(ORDER_BLOCK + log n); rank и kth — O(log n)
+class OrderIndex {
+private:
+    static const size_t ORDER_BLOCK = 512;
+
+    bool built = false;
+    vector<vector<int>> blocks;   // Непустые отсортированные блоки по возрастанию
+    vector<int> firsts;           // Первый элемент каждого блока
+    vector<int> tree;             // Дерево Фенвика по размерам блоков
+
+    // Блок, в котором лежит (или должно лежать) value
+    size_t blockOf(int value) const {
+        size_t b = upper_bound(firsts.begin(), firsts.end(), value) - firsts.begin();
+        return b == 0 ? 0 : b - 1;
+    }
+
+    // Сколько элементов в блоках 0..b-1
+    int before(size_t b) const {
+        int total = 0;
+        for (; b > 0; b &= b - 1) total += tree[b - 1];
+        return total;
+    }
+
+    void add(size_t b, int delta) {
+        for (b++; b <= tree.size(); b += b & (~b + 1)) tree[b - 1] += delta;
+    }
+
+    // Пересборка firsts и дерева после появления или исчезновения блока, O(блоков)
+    void rebuild() {
+        size_t n = blocks.size();
+        firsts.resize(n);
+        tree.assign(n, 0);
+        for (size_t i = 0; i < n; i++) {
+            firsts[i] = blocks[i].front();
+            tree[i] += (int)blocks[i].size();
+            size_t parent = (i + 1) + ((i + 1) & (~(i + 1) + 1));
+            if (parent <= n) tree[parent - 1] += tree[i];
+        }
+    }
+
+public:
+    bool ready() const { return built; }
+
+    // Построение по элементам хранилища в любом порядке
+    void build(vector<int> elements) {
+        sort(elements.begin(), elements.end());
+        blocks.clear();
+        for (size_t i = 0; i < elements.size(); i += ORDER_BLOCK) {
+            size_t to = std::min(elements.size(), i + ORDER_BLOCK);
+            blocks.emplace_back(elements.begin() + i, elements.begin() + to);
+        }
+        rebuild();
+        built = true;
+    }
+
+    // Индекс больше не нужен (очистка хранилища); память отдаётся
+    void reset() {
+        built = false;
+        vector<vector<int>>().swap(blocks);
+        vector<int>().swap(firsts);
+        vector<int>().swap(tree);
+    }
+
+    void insert(int value) {
+        if (blocks.empty()) {
+            blocks.push_back({value});
+            rebuild();
+            return;
+        }
+        size_t b = blockOf(value);
+        vector<int>& block = blocks[b];
+        auto it = lower_bound(block.begin(), block.end(), value);
+        if (it != block.end() && *it == value) return;
+        block.insert(it, value);
+        firsts[b] = block.front();
+        add(b, 1);
+        if (block.size() >= 2 * ORDER_BLOCK) {   // Переполненный блок делится пополам
+            vector<int> upper(block.begin() + ORDER_BLOCK, block.end());
+            block.resize(ORDER_BLOCK);
+            blocks.insert(blocks.begin() + b + 1, std::move(upper));
+            rebuild();
+        }
+    }
+
+    void erase(int value) {
+        if (blocks.empty()) return;
+        size_t b = blockOf(value);
+        vector<int>& block = blocks[b];
+        auto it = lower_bound(block.begin(), block.end(), value);
+        if (it == block.end() || *it != value) return;
+        block.erase(it);
+        if (block.empty()) {
+            blocks.erase(blocks.begin() + b);
+            rebuild();
+            return;
+        }
+        firsts[b] = block.front();
+        add(b, -1);
+    }
+
+    // Количество элементов меньше value
+    int rank(int value) const {
+        if (blocks.empty()) return 0;
+        size_t b = blockOf(value);
+        const vector<int>& block = blocks[b];
+        return before(b) + (int)(lower_bound(block.begin(), block.end(), value) - block.begin());
+    }
+
+    // k-й по возрастанию элемент (с нуля): спуск по дереву Фенвика к блоку
+    int kth(int k) const {
+        size_t pos = 0, step = 1;
+        while (step * 2 <= tree.size()) step *= 2;
+        for (; step > 0; step /= 2) {
+            if (pos + step <= tree.size() && tree[pos + step - 1] <= k) {
+                pos += step;
+                k -= tree[pos - 1];
+            }
+        }
+        return blocks[pos][k];
+    }
+
+    size_t memoryBytes() const {
+        size_t bytes = (blocks.capacity() * sizeof(vector<int>)) + (firsts.capacity() + tree.capacity()) * sizeof(int);
+        for (const vector<int>& block : blocks) bytes += block.capacity() * sizeof(int);
+        return bytes;
+    }
+};
+
+// Основа хранилищ без порядка: rank и kth отвечает OrderIndex, который
+// наследник обновляет в insert/erase/clear
+class UnorderedStorage : public SetStorage {
+protected:
+    mutable OrderIndex order;
+
+    const OrderIndex& orderIndex() const {
+        if (!order.ready()) {
+            vector<int> elements;
+            getElements(elements);
+            order.build(std::move(elements));
+        }
+        return order;
+    }
+
+public:
+    int rank(int value) const override { return orderIndex().rank(value); }
+    int kth(int k) const override { return orderIndex().kth(k); }
+};
+
 // Структура узла для хранения данных
 struct Node {
     int data;
@@ -14,10 +247,84 @@ struct Node {
     Node(int value) : data(value), next(nullptr) {} // Конструктор узла с значением
 };
 
-class MySet {
+// Пул узлов: узлы берутся из крупных блоков (слэбов), а не по одному через
+// new, поэтому построение списка почти не обращается к malloc, соседние
+// узлы лежат рядом в памяти, а очистка освобождает только слэбы
+class NodePool {
 private:
-    Node* head; // Указатель на начало списка
-    int count;  // Количество элементов в множестве
+    static constexpr size_t MIN_SLAB = 64;      // Узлов в первом слэбе
+    static constexpr size_t MAX_SLAB = 65536;   // Предел роста слэба
+
+    vector<Node*> slabs;     // Выделенные слэбы
+    Node* freeList;          // Освобождённые узлы, связанные через next
+    Node* cursor;            // Следующий свободный узел текущего слэба
+    Node* slabEnd;           // Конец текущего слэба
+    size_t nextSlab;         // Размер следующего слэба
+    size_t capacity;         // Узлов во всех слэбах
+
+    void addSlab(size_t nodes) {
+        cursor = static_cast<Node*>(::operator new(nodes * sizeof(Node)));
+        slabEnd = cursor + nodes;
+        slabs.push_back(cursor);
+        capacity += nodes;
+        nextSlab = std::min(nodes * 2, MAX_SLAB);
+    }
+
+public:
+    NodePool() : freeList(nullptr), cursor(nullptr), slabEnd(nullptr), nextSlab(MIN_SLAB), capacity(0) {}
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() {
+        releaseAll();
+    }
+
+    Node* allocate(int value) {
+        Node* node;
+        if (freeList != nullptr) {
+            node = freeList;
+            freeList = freeList->next;
+        } else {
+            if (cursor == slabEnd) addSlab(nextSlab);
+            node = cursor++;
+        }
+        return new (node) Node(value);
+    }
+
+    // Узел возвращается в пул и будет выдан следующим allocate
+    void release(Node* node) {
+        node->next = freeList;
+        freeList = node;
+    }
+
+    // Место ещё под n узлов одним слэбом. Остаток текущего слэба не
+    // теряется: его узлы уходят в список свободных
+    void reserve(size_t n) {
+        size_t available = (size_t)(slabEnd - cursor);
+        if (n <= available) return;
+        while (cursor != slabEnd) release(cursor++);
+        addSlab(n);
+    }
+
+    // Освобождение всех узлов сразу (Node не требует деструктора)
+    void releaseAll() {
+        for (Node* slab : slabs) ::operator delete(slab);
+        slabs.clear();
+        freeList = cursor = slabEnd = nullptr;
+        nextSlab = MIN_SLAB;
+        capacity = 0;
+    }
+
+    size_t slabCount() const { return slabs.size(); }
+    size_t bytes() const { return capacity * sizeof(Node) + slabs.capacity() * sizeof(Node*); }
+};
+
+// Хранилище на односвязном списке
+class ListStorage : public UnorderedStorage {
+private:
+    Node* head;     // Указатель на начало списка
+    int count;      // Количество элементов в множестве
+    NodePool pool;  // Память под узлы
     
     // Вспомогательная функция для поиска узла с определенным значением
     Node* findNode(int value) const {
@@ -26,99 +333,1525 @@ private:
             if (current->data == value) {
                 return current;
             }
-            current = current->next;
+            current = current->next;
+        }
+        return nullptr;
+    }
+
+public:
+    ListStorage() : head(nullptr), count(0) {} 
+    ListStorage(const ListStorage&) = delete;
+    ListStorage& operator=(const ListStorage&) = delete;
+
+    SetBackend backend() const override { return BACKEND_LIST; }
+    
+    // Добавление элемента в множество
+    bool insert(int value) override {
+        if (contains(value)) { // Проверяем, есть ли элемент уже в множестве
+            return false; // Элемент уже существует
+        }
+        
+        Node* newNode = pool.allocate(value); // Берём узел из пула
+        newNode->next = head; // Новый узел указывает на текущую голову
+        head = newNode; 
+        count++; 
+        if (order.ready()) order.insert(value);
+        return true; 
+    }
+    
+    // Удаление элемента из множества
+    bool erase(int value) override {
+        Node* current = head; // Начинаем с головы списка
+        Node* prev = nullptr; // Указатель на предыдущий узел
+        
+        while (current != nullptr) { // Проходим по всему списку
+            if (current->data == value) { // Если нашли нужный элемент
+                if (prev == nullptr) { // Если это первый элемент
+                    head = current->next; // Обновляем голову списка
+                } else {
+                    prev->next = current->next; // Пропускаем удаляемый узел
+                }
+                pool.release(current); 
+                count--; 
+                if (order.ready()) order.erase(value);
+                return true; 
+            }
+            prev = current; // Сохраняем текущий узел как предыдущий
+            current = current->next; // Переходим к следующему узлу
+        }
+        return false; 
+    }
+    
+    // Проверка наличия элемента в множестве
+    bool contains(int value) const override {
+        return findNode(value) != nullptr;
+    }
+    
+    // Получение размера множества
+    int size() const override {
+        return count; 
+    }
+    
+    // Очистка множества: все узлы освобождаются вместе со слэбами
+    void clear() override {
+        pool.releaseAll();
+        head = nullptr; // Обнуляем указатель на голову
+        count = 0; 
+        order.reset();
+    }
+
+    void reserve(size_t n) override {
+        if (n > (size_t)count) pool.reserve(n - count);
+    }
+
+    // Без поиска дубликатов: узлы сразу добавляются в начало списка
+    void insertDistinct(const vector<int>& values) override {
+        pool.reserve(values.size());
+        for (int x : values) {
+            Node* newNode = pool.allocate(x);
+            newNode->next = head;
+            head = newNode;
+        }
+        count += (int)values.size();
+        order.reset();                               // Перестроится при запросе порядка
+    }
+
+    size_t slabCount() const { return pool.slabCount(); }
+    
+    // Получение всех элементов множества 
+    void getElements(vector<int>& elements) const override {
+        elements.clear(); // Очищаем вектор элементов
+        Node* current = head; // Начинаем с головы списка
+        while (current != nullptr) { // Проходим по всему списку
+            elements.push_back(current->data); // Добавляем элемент в вектор
+            current = current->next; // Переходим к следующему узлу
+        }
+    }
+
+    size_t memoryBytes() const override {
+        return sizeof(*this) + pool.bytes() + order.memoryBytes();
+    }
+
+    long long sum() const override {
+        long long total = 0;
+        for (Node* current = head; current != nullptr; current = current->next) total += current->data;
+        return total;
+    }
+
+    // Копирование с сохранением порядка узлов
+    SetStorage* clone() const override {
+        ListStorage* copy = new ListStorage();
+        copy->pool.reserve(count);
+        Node** tail = &copy->head;
+        for (Node* current = head; current != nullptr; current = current->next) {
+            *tail = copy->pool.allocate(current->data);
+            tail = &(*tail)->next;
+        }
+        copy->count = count;
+        return copy;
+    }
+};
+
+// Хранилище на хеш-таблице с открытой адресацией и линейным пробированием
+class HashStorage : public UnorderedStorage {
+private:
+    enum SlotState : unsigned char { SLOT_EMPTY, SLOT_FULL, SLOT_DELETED };
+
+    vector<int> keys;                // Значения в ячейках
+    vector<unsigned char> states;    // Состояние каждой ячейки
+    size_t mask;                     // Ёмкость - 1 (ёмкость — степень двойки)
+    int count;                       // Количество элементов
+    size_t used;                     // Занятые и удалённые ячейки
+
+    size_t slotOf(int value) const {
+        uint64_t h = (uint64_t)(uint32_t)value * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(h >> 32) & mask;
+    }
+
+    // Ячейка со значением или первая пустая ячейка на пути пробирования
+    size_t findSlot(int value) const {
+        size_t i = slotOf(value);
+        while (states[i] != SLOT_EMPTY && !(states[i] == SLOT_FULL && keys[i] == value)) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    // Перестройка таблицы с новой ёмкостью (удалённые ячейки отбрасываются)
+    void rehash(size_t capacity) {
+        vector<int> oldKeys;
+        vector<unsigned char> oldStates;
+        oldKeys.swap(keys);
+        oldStates.swap(states);
+        keys.assign(capacity, 0);
+        states.assign(capacity, SLOT_EMPTY);
+        mask = capacity - 1;
+        used = count;
+        for (size_t i = 0; i < oldStates.size(); i++) {
+            if (oldStates[i] != SLOT_FULL) continue;
+            size_t j = slotOf(oldKeys[i]);
+            while (states[j] != SLOT_EMPTY) j = (j + 1) & mask;
+            keys[j] = oldKeys[i];
+            states[j] = SLOT_FULL;
+        }
+    }
+
+    // Ёмкость, при которой n элементов занимают не больше 70% таблицы
+    static size_t capacityFor(size_t n) {
+        size_t capacity = 16;
+        while (capacity * 7 < n * 10) capacity *= 2;
+        return capacity;
+    }
+
+public:
+    HashStorage() : mask(15), count(0), used(0) {
+        keys.assign(16, 0);
+        states.assign(16, SLOT_EMPTY);
+    }
+
+    SetBackend backend() const override { return BACKEND_HASH; }
+
+    bool insert(int value) override {
+        if ((used + 1) * 10 > (mask + 1) * 7) {      // Заполнение больше 70%
+            rehash(std::max(capacityFor((size_t)count + 1), mask + 1)); // Рост или чистка меток
+        }
+        size_t i = findSlot(value);
+        if (states[i] == SLOT_FULL) return false;
+        keys[i] = value;
+        states[i] = SLOT_FULL;
+        count++;
+        used++;
+        if (order.ready()) order.insert(value);
+        return true;
+    }
+
+    bool erase(int value) override {
+        size_t i = findSlot(value);
+        if (states[i] != SLOT_FULL) return false;
+        states[i] = SLOT_DELETED;                    // Метка сохраняет цепочки пробирования
+        count--;
+        if (order.ready()) order.erase(value);
+        return true;
+    }
+
+    bool contains(int value) const override {
+        return states[findSlot(value)] == SLOT_FULL;
+    }
+
+    int size() const override { return count; }
+
+    void clear() override {
+        keys.assign(16, 0);
+        states.assign(16, SLOT_EMPTY);
+        mask = 15;
+        count = 0;
+        used = 0;
+        order.reset();
+    }
+
+    void getElements(vector<int>& elements) const override {
+        elements.clear();
+        elements.reserve(count);
+        for (size_t i = 0; i < states.size(); i++) {
+            if (states[i] == SLOT_FULL) elements.push_back(keys[i]);
+        }
+    }
+
+    SetStorage* clone() const override { return new HashStorage(*this); }
+
+    long long sum() const override {
+        long long total = 0;
+        for (size_t i = 0; i < states.size(); i++) {
+            if (states[i] == SLOT_FULL) total += keys[i];
+        }
+        return total;
+    }
+
+    size_t memoryBytes() const override {
+        return sizeof(*this) + keys.capacity() * sizeof(int) + states.capacity() + order.memoryBytes();
+    }
+
+    void reserve(size_t n) override {
+        size_t capacity = capacityFor(n);
+        if (capacity > mask + 1) rehash(capacity);
+    }
+};
+
+// ---------- Параллельное выполнение ----------
+
+// Число потоков для операций над множествами (--threads); 1 — без потоков
+unsigned algebraThreads = 1;
+
+// Меньшие множества обрабатываются в одном потоке: запуск потоков дороже
+const size_t PARALLEL_MIN_ELEMENTS = 1 << 18;
+
+// Сколько потоков использовать для операции над elements элементами
+unsigned threadsFor(size_t elements) {
+    if (elements < PARALLEL_MIN_ELEMENTS) return 1;
+    return (unsigned)std::min<size_t>(algebraThreads, elements / (PARALLEL_MIN_ELEMENTS / 4));
+}
+
+// Пул потоков для parallelFor: потоки создаются при первой параллельной
+// операции (и досоздаются, если потоков нужно больше) и ждут следующей работы,
+// а не запускаются заново на каждую операцию. Работы выполняются по одной;
+// вызывать run из самой работы нельзя
+class ThreadPool {
+private:
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake;             // Появилась работа или пул закрывается
+    condition_variable finished;         // Все помощники закончили работу
+    const function<void()>* job = nullptr;
+    size_t generation = 0;               // Номер текущей работы
+    unsigned wanted = 0;                 // Сколько потоков ещё может взять работу
+    unsigned pending = 0;                // Сколько взявших работу не закончили
+    bool stopping = false;
+
+    void loop() {
+        size_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || (generation != seen && wanted > 0); });
+            if (stopping) return;
+            seen = generation;
+            wanted--;
+            const function<void()>* work = job;
+            guard.unlock();
+            (*work)();
+            guard.lock();
+            if (--pending == 0) finished.notify_all();
+        }
+    }
+
+    ThreadPool() {}
+
+public:
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& th : workers) th.join();
+    }
+
+    static ThreadPool& instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // work выполняется вызывающим потоком и ещё helpers потоками пула
+    void run(unsigned helpers, const function<void()>& work) {
+        static mutex single;                 // Одна работа за раз
+        lock_guard<mutex> only(single);
+        {
+            lock_guard<mutex> guard(lock);
+            while (workers.size() < helpers) workers.emplace_back([this] { loop(); });
+            job = &work;
+            wanted = helpers;
+            pending = helpers;
+            generation++;
+        }
+        wake.notify_all();
+        work();
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [&] { return pending == 0; });
+        job = nullptr;
+    }
+};
+
+// Выполнение задач 0..tasks-1 на threads потоках пула. Задач берётся больше,
+// чем потоков, и они раздаются через общий счётчик, чтобы неравные части не
+// оставляли потоки без работы
+template <typename Task>
+void parallelFor(size_t tasks, unsigned threads, Task task) {
+    atomic<size_t> next(0);
+    function<void()> worker = [&]() {
+        for (size_t t = next++; t < tasks; t = next++) task(t);
+    };
+    if (threads <= 1) {
+        worker();
+        return;
+    }
+    ThreadPool::instance().run(threads - 1, worker);
+}
+
+// Число частей, на которые делятся операнды при threads потоках
+size_t partsFor(unsigned threads) {
+    return threads > 1 ? (size_t)threads * 4 : 1;
+}
+
+// ---------- Сжатые битовые карты (по образцу Roaring) ----------
+
+// Количество единичных битов в слове
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Номер младшего единичного бита (x != 0)
+inline int countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    return popcount64((x & (~x + 1)) - 1);
+#endif
+}
+
+const int CHUNK_ARRAY_MAX = 4096;    // Больше — массив уже не меньше битовой карты
+const int CHUNK_WORDS = 1024;        // 2^16 бит в словах по 64
+
+// Блок из 2^16 соседних значений в одном из трёх представлений
+struct Chunk {
+    enum Type : unsigned char {
+        ARRAY,       // Отсортированный массив младших 16 бит
+        BITMAP,      // Битовая карта на 1024 слова
+        RUN          // Пары (начало, длина - 1) непрерывных отрезков
+    };
+    Type type = ARRAY;
+    int card = 0;                    // Количество элементов в блоке
+    vector<uint16_t> values;         // ARRAY и RUN
+    vector<uint64_t> bits;           // BITMAP
+};
+
+bool chunkContains(const Chunk& c, uint16_t low) {
+    switch (c.type) {
+        case Chunk::ARRAY:
+            return binary_search(c.values.begin(), c.values.end(), low);
+        case Chunk::BITMAP:
+            return (c.bits[low >> 6] >> (low & 63)) & 1;
+        default: {
+            size_t lo = 0, hi = c.values.size() / 2;     // Последний отрезок с началом <= low
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (c.values[2 * mid] <= low) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo > 0 && low - c.values[2 * (lo - 1)] <= c.values[2 * (lo - 1) + 1];
+        }
+    }
+}
+
+// Обход элементов блока по возрастанию
+template <typename Fn>
+void chunkForEach(const Chunk& c, Fn fn) {
+    switch (c.type) {
+        case Chunk::ARRAY:
+            for (uint16_t v : c.values) fn(v);
+            break;
+        case Chunk::BITMAP:
+            for (int w = 0; w < CHUNK_WORDS; w++) {
+                uint64_t word = c.bits[w];
+                while (word != 0) {
+                    fn((uint16_t)(w * 64 + countTrailingZeros(word)));
+                    word &= word - 1;
+                }
+            }
+            break;
+        default:
+            for (size_t i = 0; i < c.values.size(); i += 2) {
+                for (uint32_t v = c.values[i]; v <= (uint32_t)c.values[i] + c.values[i + 1]; v++) fn((uint16_t)v);
+            }
+            break;
+    }
+}
+
+// Количество элементов блока меньше low
+int chunkRank(const Chunk& c, uint16_t low) {
+    switch (c.type) {
+        case Chunk::ARRAY:
+            return (int)(lower_bound(c.values.begin(), c.values.end(), low) - c.values.begin());
+        case Chunk::BITMAP: {
+            int rank = 0;
+            for (int w = 0; w < (low >> 6); w++) rank += popcount64(c.bits[w]);
+            return rank + popcount64(c.bits[low >> 6] & ((1ULL << (low & 63)) - 1));
+        }
+        default: {
+            int rank = 0;
+            for (size_t i = 0; i < c.values.size() && c.values[i] < low; i += 2) {
+                rank += std::min<int>(low - c.values[i], c.values[i + 1] + 1);
+            }
+            return rank;
+        }
+    }
+}
+
+// k-й по возрастанию элемент блока (с нуля), 0 <= k < card
+uint16_t chunkSelect(const Chunk& c, int k) {
+    switch (c.type) {
+        case Chunk::ARRAY:
+            return c.values[k];
+        case Chunk::BITMAP: {
+            int w = 0;
+            while (popcount64(c.bits[w]) <= k) k -= popcount64(c.bits[w++]);
+            uint64_t word = c.bits[w];
+            for (; k > 0; k--) word &= word - 1;           // Снимаем k младших единиц
+            return (uint16_t)(w * 64 + countTrailingZeros(word));
+        }
+        default: {
+            size_t i = 0;
+            while (c.values[i + 1] < k) k -= c.values[i + 1] + 1, i += 2;
+            return (uint16_t)(c.values[i] + k);
+        }
+    }
+}
+
+void chunkToBitmap(Chunk& c) {
+    if (c.type == Chunk::BITMAP) return;
+    vector<uint64_t> bits(CHUNK_WORDS, 0);
+    chunkForEach(c, [&](uint16_t v) { bits[v >> 6] |= 1ULL << (v & 63); });
+    c.bits.swap(bits);
+    c.values.clear();
+    c.values.shrink_to_fit();
+    c.type = Chunk::BITMAP;
+}
+
+void chunkToArray(Chunk& c) {
+    if (c.type == Chunk::ARRAY) return;
+    vector<uint16_t> values;
+    values.reserve(c.card);
+    chunkForEach(c, [&](uint16_t v) { values.push_back(v); });
+    c.values.swap(values);
+    c.bits.clear();
+    c.bits.shrink_to_fit();
+    c.type = Chunk::ARRAY;
+}
+
+// Перевод блока из отрезков в изменяемое представление
+void chunkExpand(Chunk& c) {
+    if (c.type != Chunk::RUN) return;
+    if (c.card <= CHUNK_ARRAY_MAX) chunkToArray(c);
+    else chunkToBitmap(c);
+}
+
+// Выбор представления: битовая карта с малым числом элементов становится массивом
+void chunkNormalize(Chunk& c) {
+    if (c.type == Chunk::BITMAP && c.card <= CHUNK_ARRAY_MAX) chunkToArray(c);
+    else if (c.type == Chunk::ARRAY && c.card > CHUNK_ARRAY_MAX) chunkToBitmap(c);
+}
+
+// Пересчёт количества элементов битовой карты
+int bitmapCardinality(const vector<uint64_t>& bits) {
+    int card = 0;
+    for (int w = 0; w < CHUNK_WORDS; w++) card += popcount64(bits[w]);
+    return card;
+}
+
+// Замена представления самым компактным из трёх (массив, карта, отрезки)
+void chunkRunOptimize(Chunk& c) {
+    if (c.type == Chunk::RUN) return;
+    vector<uint16_t> runs;
+    int prev = -2;
+    chunkForEach(c, [&](uint16_t v) {
+        if (v == prev + 1) runs.back()++;
+        else { runs.push_back(v); runs.push_back(0); }
+        prev = v;
+    });
+    size_t runBytes = runs.size() * 2;
+    size_t currentBytes = c.type == Chunk::ARRAY ? c.values.size() * 2 : CHUNK_WORDS * 8;
+    if (runBytes < currentBytes) {
+        c.values.swap(runs);
+        c.values.shrink_to_fit();
+        c.bits.clear();
+        c.bits.shrink_to_fit();
+        c.type = Chunk::RUN;
+    }
+}
+
+bool chunkInsert(Chunk& c, uint16_t low) {
+    chunkExpand(c);
+    if (c.type == Chunk::BITMAP) {
+        uint64_t& word = c.bits[low >> 6];
+        uint64_t mask = 1ULL << (low & 63);
+        if (word & mask) return false;
+        word |= mask;
+        c.card++;
+        return true;
+    }
+    auto it = lower_bound(c.values.begin(), c.values.end(), low);
+    if (it != c.values.end() && *it == low) return false;
+    c.values.insert(it, low);
+    c.card++;
+    chunkNormalize(c);
+    return true;
+}
+
+bool chunkErase(Chunk& c, uint16_t low) {
+    chunkExpand(c);
+    if (c.type == Chunk::BITMAP) {
+        uint64_t& word = c.bits[low >> 6];
+        uint64_t mask = 1ULL << (low & 63);
+        if (!(word & mask)) return false;
+        word &= ~mask;
+        c.card--;
+        if (c.card <= CHUNK_ARRAY_MAX / 2) chunkToArray(c);  // Запас, чтобы не переключаться на каждом шаге
+        return true;
+    }
+    auto it = lower_bound(c.values.begin(), c.values.end(), low);
+    if (it == c.values.end() || *it != low) return false;
+    c.values.erase(it);
+    c.card--;
+    return true;
+}
+
+// Блок в изменяемом представлении (отрезки раскрываются во временную копию)
+const Chunk& expandedView(const Chunk& c, Chunk& tmp) {
+    if (c.type != Chunk::RUN) return c;
+    tmp = c;
+    chunkExpand(tmp);
+    return tmp;
+}
+
+// Слова битовой карты блока (массив переводится в карту во временной копии)
+const uint64_t* bitmapWords(const Chunk& c, Chunk& tmp) {
+    if (c.type == Chunk::BITMAP) return c.bits.data();
+    tmp = c;
+    chunkToBitmap(tmp);
+    return tmp.bits.data();
+}
+
+// Операции над блоками: объединение, пересечение, разность
+enum ChunkOp { CHUNK_OR, CHUNK_AND, CHUNK_ANDNOT };
+
+Chunk chunkCombine(const Chunk& left, const Chunk& right, ChunkOp op) {
+    Chunk ta, tb;
+    const Chunk& a = expandedView(left, ta);
+    const Chunk& b = expandedView(right, tb);
+    Chunk r;
+
+    if (a.type == Chunk::ARRAY && b.type == Chunk::ARRAY) {      // Слияние массивов
+        if (op == CHUNK_OR) set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), back_inserter(r.values));
+        else if (op == CHUNK_AND) set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), back_inserter(r.values));
+        else set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), back_inserter(r.values));
+        r.card = (int)r.values.size();
+        chunkNormalize(r);
+        return r;
+    }
+    if (op == CHUNK_AND && (a.type == Chunk::ARRAY || b.type == Chunk::ARRAY)) {
+        const Chunk& arr = a.type == Chunk::ARRAY ? a : b;           // Фильтрация массива по карте
+        const Chunk& map = a.type == Chunk::ARRAY ? b : a;
+        for (uint16_t v : arr.values) if (chunkContains(map, v)) r.values.push_back(v);
+        r.card = (int)r.values.size();
+        return r;
+    }
+    if (op == CHUNK_ANDNOT && a.type == Chunk::ARRAY) {
+        for (uint16_t v : a.values) if (!chunkContains(b, v)) r.values.push_back(v);
+        r.card = (int)r.values.size();
+        return r;
+    }
+
+    // Пословные операции над картами; циклы векторизуются компилятором
+    Chunk mapA, mapB;
+    const uint64_t* x = bitmapWords(a, mapA);
+    const uint64_t* y = bitmapWords(b, mapB);
+    r.type = Chunk::BITMAP;
+    r.bits.resize(CHUNK_WORDS);
+    uint64_t* out = r.bits.data();
+    switch (op) {
+        case CHUNK_OR:     for (int w = 0; w < CHUNK_WORDS; w++) out[w] = x[w] | y[w]; break;
+        case CHUNK_AND:    for (int w = 0; w < CHUNK_WORDS; w++) out[w] = x[w] & y[w]; break;
+        case CHUNK_ANDNOT: for (int w = 0; w < CHUNK_WORDS; w++) out[w] = x[w] & ~y[w]; break;
+    }
+    r.card = bitmapCardinality(r.bits);
+    chunkNormalize(r);
+    return r;
+}
+
+// Все элементы блока a есть в блоке b
+bool chunkSubset(const Chunk& left, const Chunk& right) {
+    if (left.card > right.card) return false;
+    Chunk ta, tb;
+    const Chunk& a = expandedView(left, ta);
+    const Chunk& b = expandedView(right, tb);
+    if (a.type == Chunk::BITMAP && b.type == Chunk::BITMAP) {
+        uint64_t extra = 0;
+        for (int w = 0; w < CHUNK_WORDS; w++) extra |= a.bits[w] & ~b.bits[w];
+        return extra == 0;
+    }
+    if (a.type == Chunk::ARRAY && b.type == Chunk::ARRAY) {
+        return includes(b.values.begin(), b.values.end(), a.values.begin(), a.values.end());
+    }
+    bool subset = true;
+    chunkForEach(a, [&](uint16_t v) { if (subset && !chunkContains(b, v)) subset = false; });
+    return subset;
+}
+
+// Хранилище в виде сжатой битовой карты: значение делится на старшие 16 бит
+// (номер блока) и младшие 16 бит (позиция внутри блока)
+class BitmapStorage : public SetStorage {
+private:
+    vector<uint16_t> keys;           // Номера непустых блоков по возрастанию
+    vector<Chunk> chunks;            // Блоки в том же порядке
+    int count;
+    mutable vector<int> before;      // Элементов в блоках до i-го; строится по запросу
+    mutable bool beforeValid = false;
+
+    // Суммы мощностей блоков для rank и kth
+    void ensureBefore() const {
+        if (beforeValid) return;
+        before.resize(chunks.size());
+        int running = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            before[i] = running;
+            running += chunks[i].card;
+        }
+        beforeValid = true;
+    }
+
+    // Сдвиг знакового диапазона, чтобы порядок блоков совпадал с порядком чисел
+    static uint32_t toUnsigned(int value) { return (uint32_t)value ^ 0x80000000u; }
+    static int toSigned(uint32_t value) { return (int)(value ^ 0x80000000u); }
+
+    // Позиция блока с номером key (или место для вставки)
+    size_t findChunk(uint16_t key) const {
+        return lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+    }
+
+    void appendChunk(uint16_t key, Chunk&& c) {
+        if (c.card == 0) return;
+        beforeValid = false;
+        count += c.card;
+        keys.push_back(key);
+        chunks.push_back(std::move(c));
+    }
+
+public:
+    BitmapStorage() : count(0) {}
+
+    SetBackend backend() const override { return BACKEND_BITMAP; }
+
+    bool insert(int value) override {
+        uint32_t u = toUnsigned(value);
+        uint16_t key = (uint16_t)(u >> 16);
+        size_t i = findChunk(key);
+        if (i == keys.size() || keys[i] != key) {
+            keys.insert(keys.begin() + i, key);
+            chunks.insert(chunks.begin() + i, Chunk());
+        }
+        if (!chunkInsert(chunks[i], (uint16_t)u)) return false;
+        beforeValid = false;
+        count++;
+        return true;
+    }
+
+    bool erase(int value) override {
+        uint32_t u = toUnsigned(value);
+        uint16_t key = (uint16_t)(u >> 16);
+        size_t i = findChunk(key);
+        if (i == keys.size() || keys[i] != key) return false;
+        if (!chunkErase(chunks[i], (uint16_t)u)) return false;
+        beforeValid = false;
+        count--;
+        if (chunks[i].card == 0) {
+            keys.erase(keys.begin() + i);
+            chunks.erase(chunks.begin() + i);
+        }
+        return true;
+    }
+
+    bool contains(int value) const override {
+        uint32_t u = toUnsigned(value);
+        uint16_t key = (uint16_t)(u >> 16);
+        size_t i = findChunk(key);
+        return i < keys.size() && keys[i] == key && chunkContains(chunks[i], (uint16_t)u);
+    }
+
+    int size() const override { return count; }
+
+    void clear() override {
+        keys.clear();
+        chunks.clear();
+        count = 0;
+        beforeValid = false;
+    }
+
+    // Элементы выдаются по возрастанию
+    void getElements(vector<int>& elements) const override {
+        elements.clear();
+        elements.reserve(count);
+        for (size_t i = 0; i < keys.size(); i++) {
+            uint32_t high = (uint32_t)keys[i] << 16;
+            chunkForEach(chunks[i], [&](uint16_t low) { elements.push_back(toSigned(high | low)); });
+        }
+    }
+
+    SetStorage* clone() const override { return new BitmapStorage(*this); }
+
+    // Элемент блока — начало блока плюс младшие 16 бит
+    long long sum() const override {
+        long long total = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            long long low = 0;
+            if (chunks[i].type == Chunk::RUN) {
+                const vector<uint16_t>& runs = chunks[i].values;
+                for (size_t r = 0; r < runs.size(); r += 2) {
+                    long long length = runs[r + 1] + 1;
+                    low += length * runs[r] + length * (length - 1) / 2;
+                }
+            } else {
+                chunkForEach(chunks[i], [&](uint16_t v) { low += v; });
+            }
+            total += (long long)chunks[i].card * toSigned((uint32_t)keys[i] << 16) + low;
+        }
+        return total;
+    }
+
+    // Сжатие блоков непрерывными отрезками там, где это выгодно
+    void optimize() override {
+        for (Chunk& c : chunks) chunkRunOptimize(c);
+    }
+
+    size_t memoryBytes() const override {
+        size_t bytes = sizeof(*this) + keys.capacity() * sizeof(uint16_t) + chunks.capacity() * sizeof(Chunk);
+        for (const Chunk& c : chunks) bytes += c.values.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+        return bytes;
+    }
+
+    // Блоки до нужного плюс позиция внутри него: O(log блоков + размер блока)
+    int rank(int value) const override {
+        uint32_t u = toUnsigned(value);
+        uint16_t key = (uint16_t)(u >> 16);
+        size_t i = findChunk(key);
+        ensureBefore();
+        if (i == keys.size()) return count;
+        return before[i] + (keys[i] == key ? chunkRank(chunks[i], (uint16_t)u) : 0);
+    }
+
+    int kth(int k) const override {
+        ensureBefore();
+        size_t i = upper_bound(before.begin(), before.end(), k) - before.begin() - 1;
+        uint32_t high = (uint32_t)keys[i] << 16;
+        return toSigned(high | chunkSelect(chunks[i], k - before[i]));
+    }
+
+    // Поблочная операция над блоками a[i..iEnd) и b[j..jEnd) с добавлением в r
+    static void combineRange(const BitmapStorage& a, size_t i, size_t iEnd,
+                             const BitmapStorage& b, size_t j, size_t jEnd, ChunkOp op, BitmapStorage& r) {
+        while (i < iEnd || j < jEnd) {
+            if (j == jEnd || (i < iEnd && a.keys[i] < b.keys[j])) {
+                if (op != CHUNK_AND) r.appendChunk(a.keys[i], Chunk(a.chunks[i]));
+                i++;
+            } else if (i == iEnd || b.keys[j] < a.keys[i]) {
+                if (op == CHUNK_OR) r.appendChunk(b.keys[j], Chunk(b.chunks[j]));
+                j++;
+            } else {
+                r.appendChunk(a.keys[i], chunkCombine(a.chunks[i], b.chunks[j], op));
+                i++;
+                j++;
+            }
+        }
+    }
+
+    // Поблочное объединение, пересечение или разность двух карт. При
+    // threads > 1 номера блоков делятся на диапазоны, каждый диапазон
+    // считается отдельно, а готовые части склеиваются по порядку
+    static BitmapStorage* combine(const BitmapStorage& a, const BitmapStorage& b, ChunkOp op, unsigned threads = 1) {
+        BitmapStorage* r = new BitmapStorage();
+        const vector<uint16_t>& longer = a.keys.size() >= b.keys.size() ? a.keys : b.keys;
+        size_t parts = std::min(partsFor(threads), longer.size());
+        if (parts <= 1) {
+            combineRange(a, 0, a.keys.size(), b, 0, b.keys.size(), op, *r);
+            return r;
+        }
+
+        // Границы частей — номера блоков, взятые равномерно из длинного списка
+        vector<size_t> aBounds(parts + 1), bBounds(parts + 1);
+        aBounds[0] = bBounds[0] = 0;
+        aBounds[parts] = a.keys.size();
+        bBounds[parts] = b.keys.size();
+        for (size_t p = 1; p < parts; p++) {
+            uint16_t key = longer[longer.size() * p / parts];
+            aBounds[p] = a.findChunk(key);
+            bBounds[p] = b.findChunk(key);
+        }
+        vector<BitmapStorage> pieces(parts);
+        parallelFor(parts, threads, [&](size_t p) {
+            combineRange(a, aBounds[p], aBounds[p + 1], b, bBounds[p], bBounds[p + 1], op, pieces[p]);
+        });
+
+        size_t total = 0;
+        for (const BitmapStorage& piece : pieces) total += piece.keys.size();
+        r->keys.reserve(total);
+        r->chunks.reserve(total);
+        for (BitmapStorage& piece : pieces) {
+            r->keys.insert(r->keys.end(), piece.keys.begin(), piece.keys.end());
+            move(piece.chunks.begin(), piece.chunks.end(), back_inserter(r->chunks));
+            r->count += piece.count;
+        }
+        r->beforeValid = false;
+        return r;
+    }
+
+    // То же, что combine, но результат замещает эту карту. Блоки, которые
+    // не меняются, переносятся без копирования, а заменённые освобождаются
+    // сразу, так что в памяти не бывает двух полных карт. Сначала составляется
+    // план (откуда берётся каждый блок результата), затем блоки считаются
+    // по частям плана на threads потоках: каждая часть пишет только свои блоки
+    void combineInPlace(const BitmapStorage& other, ChunkOp op, unsigned threads = 1) {
+        const size_t NONE = (size_t)-1;
+        struct Step { size_t i, j; };           // Свой и чужой блок (NONE — нет)
+        vector<Step> plan;
+        plan.reserve(op == CHUNK_OR ? keys.size() + other.keys.size() : keys.size());
+        size_t i = 0, j = 0;
+        while (i < keys.size() || j < other.keys.size()) {
+            if (j == other.keys.size() || (i < keys.size() && keys[i] < other.keys[j])) {
+                if (op != CHUNK_AND) plan.push_back({i, NONE});
+                else chunks[i] = Chunk();
+                i++;
+            } else if (i == keys.size() || other.keys[j] < keys[i]) {
+                if (op == CHUNK_OR) plan.push_back({NONE, j});
+                j++;
+            } else {
+                plan.push_back({i, j});
+                i++;
+                j++;
+            }
+        }
+
+        vector<uint16_t> outKeys(plan.size());
+        vector<Chunk> outChunks(plan.size());
+        size_t parts = std::min(partsFor(threads), std::max<size_t>(plan.size(), 1));
+        parallelFor(parts, threads, [&](size_t p) {
+            for (size_t s = plan.size() * p / parts; s < plan.size() * (p + 1) / parts; s++) {
+                const Step& step = plan[s];
+                if (step.j == NONE) {
+                    outKeys[s] = keys[step.i];
+                    outChunks[s] = std::move(chunks[step.i]);
+                } else if (step.i == NONE) {
+                    outKeys[s] = other.keys[step.j];
+                    outChunks[s] = other.chunks[step.j];
+                } else {
+                    outKeys[s] = keys[step.i];
+                    outChunks[s] = chunkCombine(chunks[step.i], other.chunks[step.j], op);
+                    chunks[step.i] = Chunk();
+                }
+            }
+        });
+
+        // Пересечение и разность могут дать пустые блоки: они выбрасываются
+        size_t w = 0;
+        count = 0;
+        for (size_t s = 0; s < plan.size(); s++) {
+            if (outChunks[s].card == 0) continue;
+            count += outChunks[s].card;
+            outKeys[w] = outKeys[s];
+            if (w != s) outChunks[w] = std::move(outChunks[s]);
+            w++;
+        }
+        outKeys.resize(w);
+        outChunks.resize(w);
+        keys.swap(outKeys);
+        chunks.swap(outChunks);
+        beforeValid = false;
+    }
+
+    bool isSubsetOf(const BitmapStorage& other) const {
+        if (count > other.count) return false;
+        size_t j = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            while (j < other.keys.size() && other.keys[j] < keys[i]) j++;
+            if (j == other.keys.size() || other.keys[j] != keys[i]) return false;
+            if (!chunkSubset(chunks[i], other.chunks[j])) return false;
+        }
+        return true;
+    }
+};
+
+// ---------- Отсортированный массив со слиянием ----------
+
+// Если одно множество больше другого в столько раз, слияние заменяется галопом
+const size_t GALLOP_RATIO = 32;
+
+// Экспоненциальный поиск: первая позиция >= value в v[from..]
+size_t gallop(const vector<int>& v, size_t from, int value) {
+    size_t step = 1, hi = from;
+    while (hi < v.size() && v[hi] < value) {
+        from = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > v.size()) hi = v.size();
+    return lower_bound(v.begin() + from, v.begin() + hi, value) - v.begin();
+}
+
+// Хранилище в виде отсортированного массива: поиск O(log n), операции
+// над множествами — однопроходные слияния
+class SortedStorage : public SetStorage {
+private:
+    vector<int> items;               // Элементы по возрастанию без повторов
+
+    static SortedStorage* fromSorted(vector<int>&& items) {
+        SortedStorage* r = new SortedStorage();
+        r->items = std::move(items);
+        return r;
+    }
+
+public:
+    SetBackend backend() const override { return BACKEND_SORTED; }
+
+    bool insert(int value) override {
+        auto it = lower_bound(items.begin(), items.end(), value);
+        if (it != items.end() && *it == value) return false;
+        items.insert(it, value);
+        return true;
+    }
+
+    bool erase(int value) override {
+        auto it = lower_bound(items.begin(), items.end(), value);
+        if (it == items.end() || *it != value) return false;
+        items.erase(it);
+        return true;
+    }
+
+    bool contains(int value) const override {
+        return binary_search(items.begin(), items.end(), value);
+    }
+
+    int size() const override { return (int)items.size(); }
+
+    void clear() override { items.clear(); }
+
+    void getElements(vector<int>& elements) const override { elements = items; }
+
+    SetStorage* clone() const override { return new SortedStorage(*this); }
+
+    void reserve(size_t n) override { items.reserve(n); }
+
+    // Пакетная вставка: сортировка новых элементов и одно слияние
+    void insertAll(const vector<int>& values) override {
+        size_t old = items.size();
+        items.insert(items.end(), values.begin(), values.end());
+        sort(items.begin() + old, items.end());
+        inplace_merge(items.begin(), items.begin() + old, items.end());
+        items.erase(unique(items.begin(), items.end()), items.end());
+    }
+
+    size_t memoryBytes() const override {
+        return sizeof(*this) + items.capacity() * sizeof(int);
+    }
+
+    const vector<int>& elements() const { return items; }
+
+    int rank(int value) const override {
+        return (int)(lower_bound(items.begin(), items.end(), value) - items.begin());
+    }
+
+    int kth(int k) const override { return items[k]; }
+
+    long long sum() const override {
+        long long total = 0;
+        for (int x : items) total += x;
+        return total;
+    }
+
+    // Границы частей a и b для параллельных операций: значения, взятые
+    // равномерно из большего массива, так что каждое значение попадает в
+    // одну и ту же часть обоих операндов
+    static void splitBounds(const vector<int>& a, const vector<int>& b, size_t parts,
+                            vector<size_t>& aBounds, vector<size_t>& bBounds) {
+        const vector<int>& big = a.size() >= b.size() ? a : b;
+        aBounds.assign(parts + 1, 0);
+        bBounds.assign(parts + 1, 0);
+        aBounds[parts] = a.size();
+        bBounds[parts] = b.size();
+        for (size_t p = 1; p < parts; p++) {
+            int split = big[big.size() * p / parts];
+            aBounds[p] = lower_bound(a.begin(), a.end(), split) - a.begin();
+            bBounds[p] = lower_bound(b.begin(), b.end(), split) - b.begin();
+        }
+    }
+
+    // Операции, которые пишут результат поверх items. Пересечение и
+    // разность только сдвигают оставшиеся элементы к началу массива.
+    // При threads > 1 и сравнимых размерах части считаются параллельно
+    // прямо в items, без отдельного массива результата
+
+    // Слияние с конца: массив удлиняется на размер other, и результат
+    // пишется справа налево в ещё не прочитанную часть
+    void uniteWith(const SortedStorage& other, unsigned threads = 1) {
+        const vector<int>& b = other.items;
+        if (b.size() * GALLOP_RATIO < items.size()) {
+            insertAll(b);
+            return;
+        }
+        if (threads > 1 && !items.empty()) {
+            uniteParallel(b, threads);
+            return;
+        }
+        size_t i = items.size(), j = b.size();
+        items.resize(items.size() + b.size());
+        size_t w = items.size();
+        while (j > 0) {
+            if (i > 0 && items[i - 1] >= b[j - 1]) {
+                if (items[i - 1] == b[j - 1]) j--;
+                items[--w] = items[--i];
+            } else {
+                items[--w] = b[--j];
+            }
+        }
+        items.erase(items.begin() + i, items.begin() + w);    // Промежуток от повторов
+    }
+
+    void intersectWith(const SortedStorage& other, unsigned threads = 1) {
+        const vector<int>& b = other.items;
+        size_t w = 0;
+        if (threads > 1 && comparable(b)) {
+            filterParallel(b, true, threads);
+            return;
+        }
+        if (b.size() * GALLOP_RATIO < items.size()) {           // other мало: ищем его элементы
+            size_t i = 0;
+            for (int x : b) {
+                i = gallop(items, i, x);
+                if (i == items.size()) break;
+                if (items[i] == x) items[w++] = x;
+            }
+        } else {
+            size_t j = 0;
+            for (size_t i = 0; i < items.size(); i++) {
+                j = gallop(b, j, items[i]);
+                if (j == b.size()) break;
+                if (b[j] == items[i]) items[w++] = items[i];
+            }
+        }
+        items.resize(w);
+    }
+
+    void subtractWith(const SortedStorage& other, unsigned threads = 1) {
+        const vector<int>& b = other.items;
+        size_t w = 0, i = 0;
+        if (threads > 1 && comparable(b)) {
+            filterParallel(b, false, threads);
+            return;
+        }
+        if (b.size() * GALLOP_RATIO < items.size()) {           // other мало: вырезаем его элементы
+            for (int x : b) {
+                size_t pos = gallop(items, i, x);
+                if (pos == items.size()) break;
+                if (items[pos] != x) continue;
+                if (w != i) move(items.begin() + i, items.begin() + pos, items.begin() + w);
+                w += pos - i;
+                i = pos + 1;
+            }
+            if (w != i) move(items.begin() + i, items.end(), items.begin() + w);
+            w += items.size() - i;
+        } else {
+            size_t j = 0;
+            for (; i < items.size(); i++) {
+                j = gallop(b, j, items[i]);
+                if (j == b.size() || b[j] != items[i]) items[w++] = items[i];
+            }
+        }
+        items.resize(w);
+    }
+
+    // Размеры сравнимы: галоп в одном потоке не выгоднее слияния по частям
+    bool comparable(const vector<int>& b) const {
+        return !items.empty() && !b.empty() && b.size() * GALLOP_RATIO >= items.size() &&
+               items.size() * GALLOP_RATIO >= b.size();
+    }
+
+    // Пересечение (keepPresent) или разность на месте: каждая часть сдвигает
+    // оставшиеся элементы к началу своего отрезка items, затем отрезки по
+    // порядку сдвигаются к началу массива
+    void filterParallel(const vector<int>& b, bool keepPresent, unsigned threads) {
+        size_t parts = partsFor(threads);
+        vector<size_t> aBounds, bBounds;
+        splitBounds(items, b, parts, aBounds, bBounds);
+        vector<size_t> kept(parts);
+        parallelFor(parts, threads, [&](size_t p) {
+            size_t w = aBounds[p], j = bBounds[p];
+            for (size_t i = aBounds[p]; i < aBounds[p + 1]; i++) {
+                while (j < bBounds[p + 1] && b[j] < items[i]) j++;
+                bool present = j < bBounds[p + 1] && b[j] == items[i];
+                if (present == keepPresent) items[w++] = items[i];
+            }
+            kept[p] = w - aBounds[p];
+        });
+        size_t w = 0;
+        for (size_t p = 0; p < parts; p++) {
+            move(items.begin() + aBounds[p], items.begin() + aBounds[p] + kept[p], items.begin() + w);
+            w += kept[p];
+        }
+        items.resize(w);
+    }
+
+    // Объединение на месте по частям. Часть p результата (до удаления
+    // повторов) занимает [aBounds[p] + bBounds[p], aBounds[p + 1] + bBounds[p + 1]):
+    // свои элементы части переносятся в начало этого отрезка (справа налево,
+    // чтобы не затереть непрочитанные), потом части сливаются с конца
+    // параллельно, как uniteWith, а промежутки от повторов убираются по порядку
+    void uniteParallel(const vector<int>& b, unsigned threads) {
+        size_t parts = partsFor(threads);
+        vector<size_t> aBounds, bBounds;
+        splitBounds(items, b, parts, aBounds, bBounds);
+        items.resize(items.size() + b.size());
+        for (size_t p = parts; p-- > 0;) {
+            move_backward(items.begin() + aBounds[p], items.begin() + aBounds[p + 1],
+                          items.begin() + aBounds[p + 1] + bBounds[p]);
+        }
+        vector<size_t> ownEnd(parts), mergedBegin(parts);   // Итог части: [начало, ownEnd) и [mergedBegin, конец)
+        parallelFor(parts, threads, [&](size_t p) {
+            size_t iLow = aBounds[p] + bBounds[p], end = aBounds[p + 1] + bBounds[p + 1];
+            size_t i = aBounds[p + 1] + bBounds[p], j = bBounds[p + 1], w = end;
+            while (j > bBounds[p]) {
+                if (i > iLow && items[i - 1] >= b[j - 1]) {
+                    if (items[i - 1] == b[j - 1]) j--;
+                    items[--w] = items[--i];
+                } else {
+                    items[--w] = b[--j];
+                }
+            }
+            ownEnd[p] = i;
+            mergedBegin[p] = w;
+        });
+        size_t w = 0;
+        for (size_t p = 0; p < parts; p++) {
+            size_t iLow = aBounds[p] + bBounds[p], end = aBounds[p + 1] + bBounds[p + 1];
+            w = move(items.begin() + iLow, items.begin() + ownEnd[p], items.begin() + w) - items.begin();
+            w = move(items.begin() + mergedBegin[p], items.begin() + end, items.begin() + w) - items.begin();
+        }
+        items.resize(w);
+    }
+
+    // Параллельное слияние: оба массива режутся splitBounds, части сливаются
+    // операцией merge независимо и затем копируются в результат по порядку
+    template <typename Merge>
+    static SortedStorage* parallelMerge(const vector<int>& a, const vector<int>& b, unsigned threads, Merge merge) {
+        size_t parts = partsFor(threads);
+        vector<size_t> aBounds, bBounds;
+        splitBounds(a, b, parts, aBounds, bBounds);
+
+        vector<vector<int>> pieces(parts);
+        parallelFor(parts, threads, [&](size_t p) {
+            merge(a.begin() + aBounds[p], a.begin() + aBounds[p + 1],
+                  b.begin() + bBounds[p], b.begin() + bBounds[p + 1], back_inserter(pieces[p]));
+        });
+
+        vector<size_t> offsets(parts + 1, 0);
+        for (size_t p = 0; p < parts; p++) offsets[p + 1] = offsets[p] + pieces[p].size();
+        vector<int> out(offsets[parts]);
+        parallelFor(parts, threads, [&](size_t p) {
+            copy(pieces[p].begin(), pieces[p].end(), out.begin() + offsets[p]);
+            vector<int>().swap(pieces[p]);
+        });
+        return fromSorted(std::move(out));
+    }
+
+    // Функции слияния для parallelMerge
+    struct UnionMerge {
+        template <typename It, typename Out>
+        void operator()(It a0, It a1, It b0, It b1, Out out) const { set_union(a0, a1, b0, b1, out); }
+    };
+    struct IntersectMerge {
+        template <typename It, typename Out>
+        void operator()(It a0, It a1, It b0, It b1, Out out) const { set_intersection(a0, a1, b0, b1, out); }
+    };
+    struct DifferenceMerge {
+        template <typename It, typename Out>
+        void operator()(It a0, It a1, It b0, It b1, Out out) const { set_difference(a0, a1, b0, b1, out); }
+    };
+
+    // При сильно разных размерах используется галоп в одном потоке: он и так
+    // проходит только малое множество. Потоки нужны для слияния сравнимых
+    static SortedStorage* unite(const SortedStorage& a, const SortedStorage& b, unsigned threads = 1) {
+        const vector<int>& big = a.items.size() >= b.items.size() ? a.items : b.items;
+        const vector<int>& small = a.items.size() >= b.items.size() ? b.items : a.items;
+        vector<int> out;
+        out.reserve(big.size() + small.size());
+        if (small.size() * GALLOP_RATIO < big.size()) {   // Копируем большое множество кусками
+            size_t i = 0;
+            for (int x : small) {
+                size_t pos = gallop(big, i, x);
+                out.insert(out.end(), big.begin() + i, big.begin() + pos);
+                if (pos == big.size() || big[pos] != x) out.push_back(x);
+                i = pos;
+            }
+            out.insert(out.end(), big.begin() + i, big.end());
+        } else if (threads > 1) {
+            return parallelMerge(a.items, b.items, threads, UnionMerge());
+        } else {
+            set_union(a.items.begin(), a.items.end(), b.items.begin(), b.items.end(), back_inserter(out));
+        }
+        return fromSorted(std::move(out));
+    }
+
+    static SortedStorage* intersect(const SortedStorage& a, const SortedStorage& b, unsigned threads = 1) {
+        const vector<int>& big = a.items.size() >= b.items.size() ? a.items : b.items;
+        const vector<int>& small = a.items.size() >= b.items.size() ? b.items : a.items;
+        vector<int> out;
+        if (small.size() * GALLOP_RATIO < big.size()) {   // Ищем элементы малого в большом
+            size_t i = 0;
+            for (int x : small) {
+                i = gallop(big, i, x);
+                if (i == big.size()) break;
+                if (big[i] == x) out.push_back(x);
+            }
+        } else if (threads > 1) {
+            return parallelMerge(a.items, b.items, threads, IntersectMerge());
+        } else {
+            set_intersection(a.items.begin(), a.items.end(), b.items.begin(), b.items.end(), back_inserter(out));
+        }
+        return fromSorted(std::move(out));
+    }
+
+    static SortedStorage* subtract(const SortedStorage& a, const SortedStorage& b, unsigned threads = 1) {
+        vector<int> out;
+        if (a.items.size() * GALLOP_RATIO < b.items.size()) {         // a мало: ищем его элементы в b
+            size_t j = 0;
+            for (int x : a.items) {
+                j = gallop(b.items, j, x);
+                if (j == b.items.size() || b.items[j] != x) out.push_back(x);
+            }
+        } else if (b.items.size() * GALLOP_RATIO < a.items.size()) {  // b мало: вырезаем его из a
+            out.reserve(a.items.size());
+            size_t i = 0;
+            for (int x : b.items) {
+                size_t pos = gallop(a.items, i, x);
+                out.insert(out.end(), a.items.begin() + i, a.items.begin() + pos);
+                i = (pos < a.items.size() && a.items[pos] == x) ? pos + 1 : pos;
+            }
+            out.insert(out.end(), a.items.begin() + i, a.items.end());
+        } else if (threads > 1) {
+            return parallelMerge(a.items, b.items, threads, DifferenceMerge());
+        } else {
+            set_difference(a.items.begin(), a.items.end(), b.items.begin(), b.items.end(), back_inserter(out));
+        }
+        return fromSorted(std::move(out));
+    }
+
+    bool isSubsetOf(const SortedStorage& other) const {
+        if (items.size() > other.items.size()) return false;
+        if (items.size() * GALLOP_RATIO >= other.items.size()) {
+            return includes(other.items.begin(), other.items.end(), items.begin(), items.end());
+        }
+        size_t j = 0;
+        for (int x : items) {
+            j = gallop(other.items, j, x);
+            if (j == other.items.size() || other.items[j] != x) return false;
+        }
+        return true;
+    }
+};
+
+// Создание пустого хранилища нужного типа
+SetStorage* createStorage(SetBackend backend) {
+    switch (backend) {
+        case BACKEND_HASH: return new HashStorage();
+        case BACKEND_BITMAP: return new BitmapStorage();
+        case BACKEND_SORTED: return new SortedStorage();
+        default: return new ListStorage();
+    }
+}
+
+class MySet {
+private:
+    SetStorage* storage; // Хранилище элементов
+
+    // Агрегаты поддерживаются при каждом изменении. Сумма различных int32
+    // всегда помещается в 64 бита: |сумма| <= 2^31 * 2^32 = 2^63
+    long long total;             // Сумма элементов
+    mutable int minVal, maxVal;  // Крайние элементы (при непустом множестве)
+    mutable bool extremesValid;  // false — крайний элемент удалён, нужен пересчёт
+
+    explicit MySet(SetStorage* ready) : storage(ready), minVal(0), maxVal(0) {
+        recomputeAggregates();
+    }
+
+    // Пересчёт агрегатов по хранилищу; крайние элементы — при первом запросе
+    void recomputeAggregates() {
+        total = storage->sum();
+        extremesValid = empty();
+    }
+
+    void recomputeExtremes(const vector<int>& elements) const {
+        if (!elements.empty()) {
+            minVal = *min_element(elements.begin(), elements.end());
+            maxVal = *max_element(elements.begin(), elements.end());
+        }
+        extremesValid = true;
+    }
+
+    // Ленивый пересчёт крайних элементов после удаления минимума или максимума
+    void ensureExtremes() const {
+        if (!extremesValid && (backend() == BACKEND_SORTED || backend() == BACKEND_BITMAP)) {
+            minVal = storage->kth(0);             // Упорядоченные хранилища: без копии
+            maxVal = storage->kth(size() - 1);
+            extremesValid = true;
+        }
+        if (!extremesValid) {
+            vector<int> elements;
+            getElements(elements);
+            recomputeExtremes(elements);
+        }
+    }
+
+    // Оба множества хранятся битовыми картами — доступны пословные операции
+    bool bothBitmaps(const MySet& other) const {
+        return backend() == BACKEND_BITMAP && other.backend() == BACKEND_BITMAP;
+    }
+
+    static const BitmapStorage& bitmapOf(const MySet& set) {
+        return static_cast<const BitmapStorage&>(*set.storage);
+    }
+
+    // Оба множества хранятся отсортированными массивами — доступны слияния
+    bool bothSorted(const MySet& other) const {
+        return backend() == BACKEND_SORTED && other.backend() == BACKEND_SORTED;
+    }
+
+    static const SortedStorage& sortedOf(const MySet& set) {
+        return static_cast<const SortedStorage&>(*set.storage);
+    }
+
+    // Добавление элементов, которых во множестве заведомо нет
+    void insertMissing(const vector<int>& values) {
+        bool wasEmpty = empty();
+        storage->insertDistinct(values);
+        for (int x : values) {
+            total += x;
+            if (wasEmpty) {
+                minVal = maxVal = x;
+                wasEmpty = false;
+            } else {
+                minVal = std::min(minVal, x);
+                maxVal = std::max(maxVal, x);
+            }
         }
-        return nullptr;
     }
 
 public:
-    MySet() : head(nullptr), count(0) {} 
+    MySet(SetBackend backend = BACKEND_LIST)
+        : storage(createStorage(backend)), total(0), minVal(0), maxVal(0), extremesValid(true) {} 
+
+    MySet(const MySet& other)
+        : storage(other.storage->clone()), total(other.total), minVal(other.minVal),
+          maxVal(other.maxVal), extremesValid(other.extremesValid) {}
+
+    MySet& operator=(const MySet& other) {
+        if (this != &other) {
+            SetStorage* copy = other.storage->clone();
+            delete storage;
+            storage = copy;
+            total = other.total;
+            minVal = other.minVal;
+            maxVal = other.maxVal;
+            extremesValid = other.extremesValid;
+        }
+        return *this;
+    }
+    
+    // Перемещённое множество можно только уничтожить или присвоить заново
+    MySet(MySet&& other) noexcept
+        : storage(other.storage), total(other.total), minVal(other.minVal),
+          maxVal(other.maxVal), extremesValid(other.extremesValid) {
+        other.storage = nullptr;
+    }
+
+    // Обмен содержимым: старое хранилище удалит other
+    MySet& operator=(MySet&& other) noexcept {
+        swap(storage, other.storage);
+        swap(total, other.total);
+        swap(minVal, other.minVal);
+        swap(maxVal, other.maxVal);
+        swap(extremesValid, other.extremesValid);
+        return *this;
+    }
     
     ~MySet() { 
-        clear(); 
+        delete storage; 
+    }
+
+    // Тип хранилища
+    SetBackend backend() const {
+        return storage->backend();
     }
     
     // Добавление элемента в множество
     bool insert(int value) {
-        if (contains(value)) { // Проверяем, есть ли элемент уже в множестве
-            return false; // Элемент уже существует
+        if (!storage->insert(value)) {
+            return false;
         }
-        
-        Node* newNode = new Node(value); // Создаем новый узел
-        newNode->next = head; // Новый узел указывает на текущую голову
-        head = newNode; 
-        count++; 
-        return true; 
+        total += value;
+        if (extremesValid) {
+            if (size() == 1 || value < minVal) minVal = value;
+            if (size() == 1 || value > maxVal) maxVal = value;
+        }
+        return true;
     }
     
     // Удаление элемента из множества
     bool erase(int value) {
-        Node* current = head; // Начинаем с головы списка
-        Node* prev = nullptr; // Указатель на предыдущий узел
-        
-        while (current != nullptr) { // Проходим по всему списку
-            if (current->data == value) { // Если нашли нужный элемент
-                if (prev == nullptr) { // Если это первый элемент
-                    head = current->next; // Обновляем голову списка
-                } else {
-                    prev->next = current->next; // Пропускаем удаляемый узел
-                }
-                delete current; 
-                count--; 
-                return true; 
-            }
-            prev = current; // Сохраняем текущий узел как предыдущий
-            current = current->next; // Переходим к следующему узлу
+        if (!storage->erase(value)) {
+            return false;
         }
-        return false; 
+        total -= value;
+        if (value == minVal || value == maxVal) {
+            extremesValid = empty(); // Пересчёт отложен до запроса min/max
+        }
+        return true;
     }
     
     // Проверка наличия элемента в множестве
     bool contains(int value) const {
-        return findNode(value) != nullptr;
+        return storage->contains(value);
     }
     
     // Получение размера множества
     int size() const {
-        return count; 
+        return storage->size(); 
     }
     
     // Очистка множества
     void clear() {
-        Node* current = head; // Начинаем с головы списка
-        while (current != nullptr) { // Пока есть узлы
-            Node* temp = current; // Сохраняем текущий узел
-            current = current->next; // Переходим к следующему узлу
-            delete temp; // Удаляем сохраненный узел
+        storage->clear();
+        total = 0;
+        extremesValid = true;
+    }
+
+    // Добавление сразу многих элементов
+    void insertAll(const vector<int>& values) {
+        if (values.empty()) {
+            return;
         }
-        head = nullptr; // Обнуляем указатель на голову
-        count = 0; 
+        storage->insertAll(values);
+        recomputeAggregates();
+    }
+
+    // Подготовка к добавлению n элементов
+    void reserve(size_t n) {
+        storage->reserve(n);
+    }
+
+    // Сжатие внутреннего представления после массовых изменений
+    void optimize() {
+        storage->optimize();
+    }
+
+    // Оценка памяти, занимаемой элементами
+    size_t memoryBytes() const {
+        return storage->memoryBytes();
     }
     
-    // Получение суммы всех элементов множества
-    int sum() const {
-        int total = 0;
-        Node* current = head;
-        while (current != nullptr) {
-            total += current->data;
-            current = current->next;
-        }
+    // Получение суммы всех элементов множества (O(1))
+    long long sum() const {
         return total;
     }
     
     // Получение всех элементов множества 
     void getElements(vector<int>& elements) const {
-        elements.clear(); // Очищаем вектор элементов
-        Node* current = head; // Начинаем с головы списка
-        while (current != nullptr) { // Проходим по всему списку
-            elements.push_back(current->data); // Добавляем элемент в вектор
-            current = current->next; // Переходим к следующему узлу
-        }
+        storage->getElements(elements);
     }
     
     // Проверка на пустоту множества
     bool empty() const {
-        return count == 0;
+        return size() == 0;
     }
     
     // Вывод всех элементов множества
@@ -128,95 +1861,166 @@ public:
             return;
         }
         
-        Node* current = head;
+        vector<int> elements;
+        getElements(elements);
         cout << "Элементы множества: ";
-        while (current != nullptr) {
-            cout << current->data << " ";
-            current = current->next;
+        for (int x : elements) {
+            cout << x << " ";
         }
         cout << endl;
     }
     
-    // Копирование множества
-    MySet* clone() const {
-        MySet* newSet = new MySet();
+    // Элементы, которые есть (present = true) или которых нет в other.
+    // Поиск в other только читает хранилище, поэтому части списка
+    // элементов проверяются в разных потоках
+    vector<int> filterElements(const MySet& other, bool present) const {
         vector<int> elements;
         getElements(elements);
-        for (int elem : elements) {
-            newSet->insert(elem);
-        }
-        return newSet;
+        unsigned threads = threadsFor(elements.size());
+        size_t parts = partsFor(threads);
+        vector<vector<int>> pieces(parts);
+        parallelFor(parts, threads, [&](size_t p) {
+            size_t from = elements.size() * p / parts, to = elements.size() * (p + 1) / parts;
+            for (size_t i = from; i < to; i++) {
+                if (other.contains(elements[i]) == present) {
+                    pieces[p].push_back(elements[i]);
+                }
+            }
+        });
+        if (parts == 1) return std::move(pieces[0]);
+        vector<int> selected;
+        for (const vector<int>& piece : pieces) selected.insert(selected.end(), piece.begin(), piece.end());
+        return selected;
+    }
+    
+    // Копирование множества
+    MySet* clone() const {
+        return new MySet(*this);
     }
     
     // Операция объединения множеств
     MySet* unionWith(const MySet& other) const {
-        MySet* result = clone(); // Копируем текущее множество
-        
-        vector<int> otherElements;
-        other.getElements(otherElements);
-        for (int elem : otherElements) {
-            result->insert(elem); // insert сам проверит на дубликаты
+        if (bothBitmaps(other)) {
+            return new MySet(BitmapStorage::combine(bitmapOf(*this), bitmapOf(other), CHUNK_OR, threadsFor(size() + other.size())));
         }
-        
+        if (bothSorted(other)) {
+            return new MySet(SortedStorage::unite(sortedOf(*this), sortedOf(other), threadsFor(size() + other.size())));
+        }
+        // Элементы other, которых здесь нет, ищутся по частям в разных потоках
+        // (как в filterElements), а затем дописываются к копии без проверок
+        MySet* result = clone();
+        result->insertMissing(other.filterElements(*this, false));
         return result;
     }
     
     // Операция пересечения множеств
     MySet* intersectWith(const MySet& other) const {
-        MySet* result = new MySet();
-        
-        Node* current = head;
-        while (current != nullptr) {
-            if (other.contains(current->data)) {
-                result->insert(current->data);
-            }
-            current = current->next;
+        if (bothBitmaps(other)) {
+            return new MySet(BitmapStorage::combine(bitmapOf(*this), bitmapOf(other), CHUNK_AND, threadsFor(size() + other.size())));
         }
-        
+        if (bothSorted(other)) {
+            return new MySet(SortedStorage::intersect(sortedOf(*this), sortedOf(other), threadsFor(size() + other.size())));
+        }
+        MySet* result = new MySet(backend());
+        result->insertMissing(filterElements(other, true));
         return result;
     }
     
     // Операция разности множеств
     MySet* differenceWith(const MySet& other) const {
-        MySet* result = new MySet();
-        
-        Node* current = head;
-        while (current != nullptr) {
-            if (!other.contains(current->data)) {
-                result->insert(current->data);
-            }
-            current = current->next;
+        if (bothBitmaps(other)) {
+            return new MySet(BitmapStorage::combine(bitmapOf(*this), bitmapOf(other), CHUNK_ANDNOT, threadsFor(size() + other.size())));
         }
-        
+        if (bothSorted(other)) {
+            return new MySet(SortedStorage::subtract(sortedOf(*this), sortedOf(other), threadsFor(size() + other.size())));
+        }
+        MySet* result = new MySet(backend());
+        result->insertMissing(filterElements(other, false));
         return result;
     }
     
+    // Объединение, пересечение и разность, изменяющие само множество.
+    // Временная копия множества не создаётся и при нескольких потоках:
+    // части считаются параллельно прямо в хранилище этого множества
+    void unionInPlace(const MySet& other) {
+        if (&other == this) return;
+        unsigned threads = threadsFor(size() + other.size());
+        if (bothBitmaps(other)) {
+            static_cast<BitmapStorage*>(storage)->combineInPlace(bitmapOf(other), CHUNK_OR, threads);
+            recomputeAggregates();
+            return;
+        }
+        if (bothSorted(other)) {
+            static_cast<SortedStorage*>(storage)->uniteWith(sortedOf(other), threads);
+            recomputeAggregates();
+            return;
+        }
+        insertMissing(other.filterElements(*this, false));
+    }
+
+    void intersectInPlace(const MySet& other) {
+        if (&other == this) return;
+        unsigned threads = threadsFor(size() + other.size());
+        if (bothBitmaps(other)) {
+            static_cast<BitmapStorage*>(storage)->combineInPlace(bitmapOf(other), CHUNK_AND, threads);
+            recomputeAggregates();
+            return;
+        }
+        if (bothSorted(other)) {
+            static_cast<SortedStorage*>(storage)->intersectWith(sortedOf(other), threads);
+            recomputeAggregates();
+            return;
+        }
+        for (int x : filterElements(other, false)) {
+            erase(x);
+        }
+    }
+
+    void subtractInPlace(const MySet& other) {
+        if (&other == this) {
+            clear();
+            return;
+        }
+        unsigned threads = threadsFor(size() + other.size());
+        if (bothBitmaps(other)) {
+            static_cast<BitmapStorage*>(storage)->combineInPlace(bitmapOf(other), CHUNK_ANDNOT, threads);
+            recomputeAggregates();
+            return;
+        }
+        if (bothSorted(other)) {
+            static_cast<SortedStorage*>(storage)->subtractWith(sortedOf(other), threads);
+            recomputeAggregates();
+            return;
+        }
+        for (int x : filterElements(other, true)) {
+            erase(x);
+        }
+    }
+
     // Проверка на подмножество
     bool isSubsetOf(const MySet& other) const {
-        Node* current = head;
-        while (current != nullptr) {
-            if (!other.contains(current->data)) {
+        if (bothBitmaps(other)) {
+            return bitmapOf(*this).isSubsetOf(bitmapOf(other));
+        }
+        if (bothSorted(other)) {
+            return sortedOf(*this).isSubsetOf(sortedOf(other));
+        }
+        vector<int> elements;
+        getElements(elements);
+        for (int elem : elements) {
+            if (!other.contains(elem)) {
                 return false;
             }
-            current = current->next;
         }
         return true;
     }
     
     // Проверка на равенство множеств
     bool equals(const MySet& other) const {
-        if (count != other.count) {
+        if (size() != other.size()) {
             return false;
         }
-        
-        Node* current = head;
-        while (current != nullptr) {
-            if (!other.contains(current->data)) {
-                return false;
-            }
-            current = current->next;
-        }
-        return true;
+        return isSubsetOf(other);
     }
     
     // Поиск максимального элемента
@@ -224,112 +2028,662 @@ public:
         if (empty()) {
             throw runtime_error("Множество пусто");
         }
-        
-        int maxVal = head->data;
-        Node* current = head->next;
-        while (current != nullptr) {
-            if (current->data > maxVal) {
-                maxVal = current->data;
+        ensureExtremes();
+        return maxVal;
+    }
+    
+    // Поиск минимального элемента
+    int min() const {
+        if (empty()) {
+            throw runtime_error("Множество пусто");
+        }
+        ensureExtremes();
+        return minVal;
+    }
+
+    // Количество элементов меньше value
+    int rank(int value) const {
+        return storage->rank(value);
+    }
+
+    // k-й по возрастанию элемент, k от 1 до size()
+    int kth(int k) const {
+        if (k < 1 || k > size()) {
+            throw runtime_error("Нет элемента с номером " + to_string(k));
+        }
+        return storage->kth(k - 1);
+    }
+
+    // Количество элементов в отрезке [from, to]
+    int countRange(int from, int to) const {
+        if (from > to) {
+            return 0;
+        }
+        return rank(to) - rank(from) + (contains(to) ? 1 : 0);
+    }
+};
+
+// ---------- Быстрый разбор чисел ----------
+//
+// Текстовый файл читается блоками по PARSE_CHUNK_BYTES и разбирается прямо
+// в буфере за один проход по символам, без потоков ввода и исключений.
+// Некорректные лексемы пропускаются и подсчитываются в ParseReport
+
+const size_t PARSE_CHUNK_BYTES = 1 << 22;
+
+// ParseReport, isSeparator и parseIntTokens дословно повторяются в 3partition.cpp:
+// программы собираются по отдельности. Копии меняются только вместе
+
+// Итог разбора: сколько лексем отброшено и какая была первой
+struct ParseReport {
+    size_t malformed = 0;
+    string firstMalformed;
+    size_t firstOffset = 0;      // Смещение первой некорректной лексемы в тексте
+};
+
+inline bool isSeparator(char c) {
+    return (unsigned char)c <= ' ';  // Пробел, перевод строки, табуляция и прочие управляющие
+}
+
+// Разбор чисел, разделённых пробельными символами, в [p, end). offset —
+// смещение p от начала всего текста. Если final == false, лексема,
+// упирающаяся в end, может продолжаться в следующем блоке: она не
+// разбирается, а возвращается позиция её начала
+const char* parseIntTokens(const char* p, const char* end, bool final, size_t offset,
+                           vector<int>& out, ParseReport& report) {
+    const char* begin = p;
+    while (true) {
+        while (p != end && isSeparator(*p)) p++;
+        if (p == end) return end;
+        const char* token = p;
+
+        // Цифры накапливаются в 64 бита тем же проходом, что ищет конец
+        // лексемы; переполнение int32 проверяется один раз в конце
+        bool negative = *p == '-';
+        p += negative || *p == '+';           // Как и operator>>, допускаем "+5"
+        const char* digits = p;
+        while (p != end && *p == '0') p++;   // Ведущие нули не считаются в длину
+        const char* significant = p;
+        uint64_t value = 0;
+        unsigned digit;
+        while (p != end && (digit = (unsigned char)*p - '0') < 10) {
+            value = value * 10 + digit;
+            p++;
+        }
+        bool valid = p != digits && p - significant <= 10 && value <= 2147483647u + (uint64_t)negative
+                     && (p == end || isSeparator(*p));
+        while (p != end && !isSeparator(*p)) p++;
+        if (p == end && !final) return token;
+
+        if (valid) {
+            out.push_back(negative ? (int)(0 - value) : (int)value);
+        } else {
+            if (report.malformed++ == 0) {
+                report.firstMalformed.assign(token, std::min<size_t>(p - token, 32));
+                report.firstOffset = offset + (token - begin);
+            }
+        }
+    }
+}
+
+// Все числа из текстового файла; false, если файл не открылся
+bool readIntegersFromFile(const string& filePath, vector<int>& out, ParseReport& report) {
+    ifstream inFile(filePath, ios::binary);
+    if (!inFile.is_open()) {
+        return false;
+    }
+    vector<char> buffer(PARSE_CHUNK_BYTES);
+    size_t carry = 0;        // Незаконченная лексема из прошлого блока в начале буфера
+    size_t offset = 0;       // Смещение начала буфера в файле
+    while (true) {
+        if (carry == buffer.size()) buffer.resize(buffer.size() * 2);  // Лексема длиннее блока
+        inFile.read(buffer.data() + carry, buffer.size() - carry);
+        size_t filled = carry + (size_t)inFile.gcount();
+        bool final = filled < buffer.size();
+        const char* stop = parseIntTokens(buffer.data(), buffer.data() + filled, final, offset, out, report);
+        if (final) break;
+        carry = buffer.data() + filled - stop;
+        memmove(buffer.data(), stop, carry);
+        offset += filled - carry;
+    }
+    return true;
+}
+
+// Сообщение о пропущенных при разборе лексемах
+void printParseReport(const ParseReport& report, const string& source) {
+    if (report.malformed == 0) {
+        return;
+    }
+    cerr << source << ": пропущено некорректных значений: " << report.malformed
+         << " (первое \"" << report.firstMalformed << "\" на позиции " << report.firstOffset << ")\n";
+}
+
+// ---------- Двоичный формат файла множества ----------
+//
+// Заголовок SetFileHeader, затем count чисел int32 по возрастанию.
+// Числа пишутся в порядке байтов машины (little-endian на x86 и ARM)
+
+const char SET_FILE_MAGIC[4] = {'M', 'S', 'E', 'T'};
+const uint32_t SET_FILE_VERSION = 1;
+
+struct SetFileHeader {
+    char magic[4];       // "MSET"
+    uint32_t version;    // Версия формата
+    uint64_t count;      // Количество элементов
+    int32_t min;         // Минимальный элемент (0, если множество пусто)
+    int32_t max;         // Максимальный элемент (0, если множество пусто)
+    int64_t sum;         // Сумма элементов
+};
+static_assert(sizeof(SetFileHeader) == 32, "Заголовок файла должен занимать 32 байта");
+
+// Формат, в котором множество сохраняется в файл
+enum SetFileFormat {
+    FORMAT_TEXT,         // Числа через пробел
+    FORMAT_BINARY        // Заголовок и упакованные отсортированные числа
+};
+
+// Порог сжатия журнала по умолчанию (в записях)
+const size_t JOURNAL_COMPACT_RECORDS = 65536;
+
+// Файл множества и параметры его сохранения
+struct SetFile {
+    string path;
+    SetFileFormat format = FORMAT_TEXT;
+    bool journal = false;                            // Изменения дописываются в журнал
+    size_t compactRecords = JOURNAL_COMPACT_RECORDS; // После стольких записей журнал сливается с файлом
+};
+
+// Проверка, что файл записан в двоичном формате
+bool isBinarySetFile(const string& filePath) {
+    ifstream in(filePath, ios::binary);
+    char magic[4];
+    return in.read(magic, 4) && memcmp(magic, SET_FILE_MAGIC, 4) == 0;
+}
+
+// Двоичный файл множества, отображённый в память только для чтения.
+// Запросы выполняются прямо по файлу, без построения MySet
+class MappedSetFile {
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    vector<char> buffer;             // Без mmap файл читается в память целиком
+#endif
+
+public:
+    MappedSetFile() {}
+    MappedSetFile(const MappedSetFile&) = delete;
+    MappedSetFile& operator=(const MappedSetFile&) = delete;
+
+    ~MappedSetFile() {
+#ifndef _WIN32
+        if (data != nullptr && length > 0) munmap((void*)data, length);
+#endif
+    }
+
+    // Открытие файла; false, если файла нет или он не в двоичном формате
+    bool open(const string& filePath) {
+#ifdef _WIN32
+        ifstream in(filePath, ios::binary);
+        if (!in) return false;
+        buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        data = buffer.data();
+        length = buffer.size();
+#else
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SetFileHeader)) {
+            close(fd);
+            return false;
+        }
+        length = (size_t)st.st_size;
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+        data = (const char*)mapped;
+#endif
+        if (length < sizeof(SetFileHeader) || memcmp(data, SET_FILE_MAGIC, 4) != 0) return false;
+        const SetFileHeader& h = header();
+        if (h.version != SET_FILE_VERSION) return false;
+        // Сравнение делением: умножение count на размер числа может переполниться
+        return h.count <= (length - sizeof(SetFileHeader)) / sizeof(int32_t);
+    }
+
+    const SetFileHeader& header() const { return *(const SetFileHeader*)data; }
+
+    size_t size() const { return (size_t)header().count; }
+
+    const int32_t* elements() const { return (const int32_t*)(data + sizeof(SetFileHeader)); }
+
+    // Двоичный поиск по отсортированным элементам
+    bool contains(int value) const {
+        return binary_search(elements(), elements() + size(), (int32_t)value);
+    }
+};
+
+// Сброс содержимого файла (или каталога) на диск. В Windows не выполняется
+bool syncFile(const string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+// Атомарная замена path уже записанным tmpPath: после сбоя на диске
+// останется либо старое, либо новое содержимое целиком
+bool replaceFile(const string& path, const string& tmpPath) {
+    if (!syncFile(tmpPath)) {
+        return false;
+    }
+    error_code ec;
+    filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        return false;
+    }
+    string dir = filesystem::path(path).parent_path().string();
+    syncFile(dir.empty() ? "." : dir);  // Запись о переименовании в каталоге
+    return true;
+}
+
+// Запись множества в двоичном формате через временный файл; false, если
+// записать не удалось (тогда прежний файл не тронут)
+bool saveBinarySet(const MySet& mySet, const string& filePath) {
+    vector<int> elements;
+    mySet.getElements(elements);
+    if (mySet.backend() != BACKEND_SORTED && mySet.backend() != BACKEND_BITMAP) {
+        sort(elements.begin(), elements.end());
+    }
+
+    SetFileHeader h;
+    memcpy(h.magic, SET_FILE_MAGIC, 4);
+    h.version = SET_FILE_VERSION;
+    h.count = elements.size();
+    h.min = elements.empty() ? 0 : elements.front();
+    h.max = elements.empty() ? 0 : elements.back();
+    h.sum = mySet.sum();
+
+    string tmpPath = filePath + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)elements.data(), elements.size() * sizeof(int32_t));
+    out.close();
+    if (!out || !replaceFile(filePath, tmpPath)) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ---------- Журнал изменений ----------
+//
+// Рядом с файлом множества лежит <файл>.journal из записей по 5 байт:
+// '+' или '-' и число int32. При загрузке записи применяются к файлу по порядку;
+// неполная запись в конце (обрыв при записи) отбрасывается
+
+const size_t JOURNAL_RECORD_SIZE = 5;
+
+// Одно изменение множества
+struct JournalRecord {
+    char op;             // '+' — добавление, '-' — удаление
+    int value;
+};
+
+string journalPath(const string& filePath) {
+    return filePath + ".journal";
+}
+
+// Количество полных записей в журнале (0, если журнала нет)
+size_t journalRecordCount(const string& filePath) {
+    error_code ec;
+    uintmax_t bytes = filesystem::file_size(journalPath(filePath), ec);
+    return ec ? 0 : (size_t)(bytes / JOURNAL_RECORD_SIZE);
+}
+
+// Дописывание изменений в конец журнала
+bool appendJournal(const string& filePath, const vector<JournalRecord>& records) {
+    string buffer;
+    buffer.reserve(records.size() * JOURNAL_RECORD_SIZE);
+    for (const JournalRecord& r : records) {
+        int32_t v = r.value;
+        buffer += r.op;
+        buffer.append((const char*)&v, sizeof(v));
+    }
+    FILE* f = fopen(journalPath(filePath).c_str(), "ab");
+    if (f == nullptr) return false;
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+    return fclose(f) == 0 && ok;
+}
+
+// Чтение всех полных записей журнала
+vector<JournalRecord> readJournal(const string& filePath) {
+    vector<JournalRecord> records;
+    ifstream in(journalPath(filePath), ios::binary);
+    char record[JOURNAL_RECORD_SIZE];
+    while (in.read(record, JOURNAL_RECORD_SIZE)) {
+        int32_t v;
+        memcpy(&v, record + 1, sizeof(v));
+        if (record[0] == '+' || record[0] == '-') records.push_back({record[0], v});
+    }
+    return records;
+}
+
+// Применение журнала к загруженному множеству
+void replayJournal(MySet& mySet, const string& filePath) {
+    for (const JournalRecord& r : readJournal(filePath)) {
+        if (r.op == '+') mySet.insert(r.value);
+        else mySet.erase(r.value);
+    }
+}
+
+// Текущее состояние двоичного файла с учётом журнала. Агрегаты берутся из
+// заголовка и поправляются по журналу: запросы стоят O(log n + длина журнала).
+// Порядковые запросы (rank, kth) ищут двоичным поиском по отсортированному
+// файлу и по отсортированным спискам добавленных и удалённых журналом чисел
+class SetFileView {
+private:
+    MappedSetFile mapped;
+    unordered_map<int, bool> latest;     // Итог журнала по числу: true — присутствует
+    vector<int> added;                   // Добавлены журналом, в файле их нет (по возрастанию)
+    vector<int> removed;                 // Есть в файле, удалены журналом (по возрастанию)
+    uint64_t count = 0;
+    int64_t total = 0;
+
+    bool present(int value) const {
+        auto it = latest.find(value);
+        return it != latest.end() ? it->second : mapped.contains(value);
+    }
+
+public:
+    bool open(const string& filePath) {
+        if (!mapped.open(filePath)) {
+            return false;
+        }
+        for (const JournalRecord& r : readJournal(filePath)) {
+            latest[r.value] = r.op == '+';
+        }
+        count = mapped.header().count;
+        total = mapped.header().sum;
+        for (const auto& entry : latest) {
+            bool inBase = mapped.contains(entry.first);
+            if (entry.second && !inBase) { count++; total += entry.first; added.push_back(entry.first); }
+            if (!entry.second && inBase) { count--; total -= entry.first; removed.push_back(entry.first); }
+        }
+        sort(added.begin(), added.end());
+        sort(removed.begin(), removed.end());
+        return true;
+    }
+
+    bool contains(int value) const { return present(value); }
+
+    uint64_t size() const { return count; }
+
+    int64_t sum() const { return total; }
+
+    // Количество элементов меньше value, O(log n + log длины журнала)
+    uint64_t rank(int value) const {
+        const int32_t* begin = mapped.elements();
+        uint64_t below = lower_bound(begin, begin + mapped.size(), (int32_t)value) - begin;
+        below += lower_bound(added.begin(), added.end(), value) - added.begin();
+        return below - (lower_bound(removed.begin(), removed.end(), value) - removed.begin());
+    }
+
+    // k-й по возрастанию элемент (с нуля), k < size(): наибольшее value,
+    // у которого rank(value) <= k, — двоичный поиск по значениям, 32 шага по rank
+    int kth(uint64_t k) const {
+        int64_t lo = numeric_limits<int>::min(), hi = numeric_limits<int>::max();
+        while (lo < hi) {
+            int64_t mid = lo + (hi - lo + 1) / 2;
+            if (rank((int)mid) <= k) lo = mid;
+            else hi = mid - 1;
+        }
+        return (int)lo;
+    }
+
+    // Крайний элемент: min/max из заголовка, если журнал его не удалил, иначе
+    // первый неудалённый элемент файла с нужного конца; затем учитываются
+    // добавленные журналом числа. false, если множество пусто
+    bool extreme(bool wantMax, int& result) const {
+        const int32_t* begin = mapped.elements();
+        size_t n = mapped.size();
+        bool found = false;
+        if (n > 0) {
+            int edge = wantMax ? mapped.header().max : mapped.header().min;
+            auto it = latest.find(edge);
+            if (it == latest.end() || it->second) {
+                result = edge;
+                found = true;
             }
-            current = current->next;
         }
-        return maxVal;
-    }
-    
-    // Поиск минимального элемента
-    int min() const {
-        if (empty()) {
-            throw runtime_error("Множество пусто");
+        for (size_t k = 0; !found && k < n; k++) {      // Только если край удалён журналом
+            int x = begin[wantMax ? n - 1 - k : k];
+            auto it = latest.find(x);
+            if (it == latest.end() || it->second) {
+                result = x;
+                found = true;
+                break;
+            }
         }
-        
-        int minVal = head->data;
-        Node* current = head->next;
-        while (current != nullptr) {
-            if (current->data < minVal) {
-                minVal = current->data;
+        for (const auto& entry : latest) {
+            if (entry.second && (!found || (wantMax ? entry.first > result : entry.first < result))) {
+                result = entry.first;
+                found = true;
             }
-            current = current->next;
         }
-        return minVal;
+        return found;
     }
 };
 
-// Функция для сохранения множества в файл
-void saveSetToFile(const MySet& mySet, const string& filePath) {
-    ofstream outFile(filePath); 
-    vector<int> elements; // Вектор для хранения элементов
-    mySet.getElements(elements); // Получаем все элементы множества
+// Функция для сохранения множества в файл (журнал становится не нужен).
+// Файл пишется под временным именем и заменяет старый целиком; журнал
+// удаляется только после этого. false, если записать не удалось
+bool saveSetToFile(const MySet& mySet, const SetFile& file) {
+    bool saved;
+    if (file.format == FORMAT_BINARY) {
+        saved = saveBinarySet(mySet, file.path);
+    }
+    else {
+        string tmpPath = file.path + ".tmp";
+        ofstream outFile(tmpPath); 
+        vector<int> elements; // Вектор для хранения элементов
+        mySet.getElements(elements); // Получаем все элементы множества
     
-    for (int x : elements) { 
-        outFile << x << " "; 
+        for (int x : elements) { 
+            outFile << x << " "; 
+        }
+        outFile.close(); 
+        saved = outFile && replaceFile(file.path, tmpPath);
+        if (!saved) remove(tmpPath.c_str());
+    }
+    if (!saved) {
+        cerr << "Не удалось записать файл " << file.path << "\n";   // Журнал остаётся
+        return false;
     }
-    outFile.close(); 
+    remove(journalPath(file.path).c_str());
+    return true;
 }
 
-// Функция для загрузки множества из файла
-MySet loadSetFromFile(const string& filePath) {
-    MySet mySet;
-    ifstream inFile(filePath);
-    if (!inFile.is_open()) {
-        return mySet; // Возвращаем пустое множество, если файл не существует
+// Сохранение отдельных изменений: в режиме журнала — дописыванием записей,
+// с полной перезаписью файла, когда журнал становится слишком длинным
+void saveChanges(const MySet& mySet, const SetFile& file, const vector<JournalRecord>& records) {
+    if (records.empty()) {
+        return;
     }
-    
-    int num;
-    while (inFile >> num) {
-        mySet.insert(num);
+    if (file.journal && appendJournal(file.path, records)) {
+        size_t threshold = std::max(file.compactRecords, (size_t)mySet.size() / 2);
+        if (journalRecordCount(file.path) <= threshold) {
+            return;
+        }
+    }
+    saveSetToFile(mySet, file); // Сжатие журнала или обычное сохранение
+}
+
+// Функция для загрузки множества из файла
+MySet loadSetFromFile(const string& filePath, SetBackend backend = BACKEND_LIST) {
+    MySet mySet(backend);
+    MappedSetFile mapped;
+    if (mapped.open(filePath)) { // Двоичный формат: элементы уже отсортированы
+        mySet.insertAll(vector<int>(mapped.elements(), mapped.elements() + mapped.size()));
+    } else {
+        vector<int> values;
+        ParseReport report;
+        if (readIntegersFromFile(filePath, values, report)) { // Если файла нет, множество останется пустым
+            printParseReport(report, filePath);
+        }
+        mySet.insertAll(values);
     }
-    inFile.close();
+    replayJournal(mySet, filePath);
+    mySet.optimize();
     return mySet;
 }
 
-// Функция добавления элементов в множество
-void SETADD(MySet& mySet, const string& filePath) {
-    cout << "Введите числа для добавления через пробел: ";
-    string line; 
+// ---------- Операции над множеством ----------
+//
+// Каждая операция получает операнды готовым списком и только отмечает
+// изменения в PendingChanges; запись в файл выполняет flushChanges. Так
+// одни и те же операции работают и в интерактивном, и в пакетном режиме
 
-    // Считываем всю строку чисел сразу
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    getline(cin, line); // Читаем всю строку из cin
+// Изменения множества, ещё не записанные в файл
+struct PendingChanges {
+    vector<JournalRecord> records;   // Добавления и удаления отдельных элементов
+    bool rewrite = false;            // Нужна полная перезапись файла
+};
 
-    stringstream ss(line); // Создаем поток из строки для разбиения на числа
-    int num; // Переменная для хранения числа
-    bool changed = false;  // Флаг, чтобы определить, нужно ли сохранять файл
+// Запись накопленных изменений в файл
+void flushChanges(const MySet& mySet, const SetFile& file, PendingChanges& pending) {
+    if (pending.rewrite) {
+        saveSetToFile(mySet, file);
+    } else {
+        saveChanges(mySet, file, pending.records); // Сохраняем только если были изменения
+    }
+    pending.records.clear();
+    pending.rewrite = false;
+}
+
+// Разбор чисел из строки
+vector<int> parseNumbers(const string& line) {
+    vector<int> numbers;
+    ParseReport report;
+    parseIntTokens(line.data(), line.data() + line.size(), true, 0, numbers, report);
+    printParseReport(report, "Ввод");
+    return numbers;
+}
+
+// Чтение строки чисел в интерактивном режиме
+vector<int> readNumbersLine() {
+    string line;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Игнорируем оставшиеся символы в буфере
+    getline(cin, line);
+    return parseNumbers(line);
+}
 
-    while (ss >> num) {    // Считываем числа по очереди из потока
+void addElements(MySet& mySet, const vector<int>& numbers, PendingChanges& pending) {
+    for (int num : numbers) {
         if (mySet.insert(num)) { // Пытаемся добавить число в множество
             cout << num << " добавлено\n"; 
-            changed = true; // Устанавливаем флаг изменений
+            pending.records.push_back({'+', num}); // Запоминаем изменение
         } else {
             cout << num << " уже есть\n"; 
         }
     }
-
-    if (changed) saveSetToFile(mySet, filePath); // Сохраняем только если были изменения
 }
 
-// Функция удаления элементов из множества
-void SETDEL(MySet& mySet, const string& filePath) {
-    cout << "Введите числа для удаления через пробел: ";
-    string line; // Строка для ввода чисел
-
-    // Очистка буфера ввода, чтобы getline считал корректно
-    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Игнорируем оставшиеся символы в буфере
-
-    getline(cin, line);       // Считываем строку с числами для удаления
-    stringstream ss(line);    // Создаем поток из строки
-    int num; // Переменная для хранения числа
-    bool changed = false;     // Флаг, чтобы определить, нужно ли сохранять файл
-
-    while (ss >> num) { // Считываем числа по очереди
+void removeElements(MySet& mySet, const vector<int>& numbers, PendingChanges& pending) {
+    for (int num : numbers) {
         if (mySet.erase(num)) { // Пытаемся удалить число из множества
-            cout << num << " удалено\n"; // Сообщение об успешном удалении
-            changed = true; 
+            cout << num << " удалено\n"; 
+            pending.records.push_back({'-', num}); 
         } else {
             cout << num << " не найдено\n"; 
         }
     }
+}
+
+void checkElement(const MySet& mySet, int num) {
+    if (mySet.contains(num)) // Проверяем наличие числа в множестве
+        cout << num << " присутствует\n"; 
+    else
+        cout << num << " отсутствует\n"; 
+}
+
+void clearSet(MySet& mySet, PendingChanges& pending) {
+    mySet.clear();
+    pending.rewrite = true;
+    cout << "Множество очищено" << endl;
+}
+
+// Операции над текущим множеством и множеством из введённых чисел
+enum SetOperation { OP_UNION, OP_INTERSECT, OP_DIFFERENCE };
+
+void combineWith(MySet& mySet, const vector<int>& numbers, SetOperation op, PendingChanges& pending) {
+    MySet otherSet(mySet.backend()); // То же хранилище — доступны быстрые операции
+    otherSet.insertAll(numbers);
+    
+    if (op == OP_UNION) mySet.unionInPlace(otherSet);
+    else if (op == OP_INTERSECT) mySet.intersectInPlace(otherSet);
+    else mySet.subtractInPlace(otherSet);
+    pending.rewrite = true;
+
+    if (op == OP_UNION) cout << "Множества объединены" << endl;
+    else if (op == OP_INTERSECT) cout << "Найдено пересечение множеств" << endl;
+    else cout << "Выполнена разность множеств" << endl;
+}
+
+void checkSubset(const MySet& mySet, const vector<int>& numbers) {
+    MySet otherSet(mySet.backend());
+    otherSet.insertAll(numbers);
+    
+    if (mySet.isSubsetOf(otherSet)) {
+        cout << "Текущее множество является подмножеством введенного" << endl;
+    } else {
+        cout << "Текущее множество НЕ является подмножеством введенного" << endl;
+    }
+}
+
+void countRange(const MySet& mySet, int from, int to) {
+    cout << "Элементов в отрезке [" << from << ", " << to << "]: " << mySet.countRange(from, to) << endl;
+}
+
+void printRank(const MySet& mySet, int value) {
+    cout << "Элементов меньше " << value << ": " << mySet.rank(value) << endl;
+}
+
+void printKth(const MySet& mySet, int k) {
+    try {
+        int value = mySet.kth(k);
+        cout << k << "-й по возрастанию элемент: " << value << endl;
+    } catch (const runtime_error& e) {
+        cout << e.what() << endl;
+    }
+}
+
+// ---------- Интерактивные команды ----------
+
+// Функция добавления элементов в множество
+void SETADD(MySet& mySet, const SetFile& file) {
+    cout << "Введите числа для добавления через пробел: ";
+    PendingChanges pending;
+    addElements(mySet, readNumbersLine(), pending);
+    flushChanges(mySet, file, pending);
+}
 
-    if (changed) saveSetToFile(mySet, filePath); // Сохраняем только если были изменения
+// Функция удаления элементов из множества
+void SETDEL(MySet& mySet, const SetFile& file) {
+    cout << "Введите числа для удаления через пробел: ";
+    PendingChanges pending;
+    removeElements(mySet, readNumbersLine(), pending);
+    flushChanges(mySet, file, pending);
 }
 
 // Функция проверки наличия элемента в множестве
@@ -337,10 +2691,7 @@ void SET_AT(const MySet& mySet) {
     cout << "Введите число для проверки: ";
     int num; // Переменная для хранения числа
     cin >> num;                 // Считываем одно число
-    if (mySet.contains(num)) // Проверяем наличие числа в множестве
-        cout << num << " присутствует\n"; 
-    else
-        cout << num << " отсутствует\n"; 
+    checkElement(mySet, num);
 }
 
 // Функция вывода размера множества
@@ -354,10 +2705,10 @@ void SET_PRINT(const MySet& mySet) {
 }
 
 // Функция очистки множества
-void SET_CLEAR(MySet& mySet, const string& filePath) {
-    mySet.clear();
-    saveSetToFile(mySet, filePath);
-    cout << "Множество очищено" << endl;
+void SET_CLEAR(MySet& mySet, const SetFile& file) {
+    PendingChanges pending;
+    clearSet(mySet, pending);
+    flushChanges(mySet, file, pending);
 }
 
 // Функция вывода суммы элементов множества
@@ -384,90 +2735,189 @@ void SET_MIN(const MySet& mySet) {
 }
 
 // Функция объединения множеств
-void SET_UNION(MySet& mySet, const string& filePath) {
+void SET_UNION(MySet& mySet, const SetFile& file) {
     cout << "Введите числа для второго множества через пробел: ";
-    string line;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    getline(cin, line);
-    
-    MySet otherSet;
-    stringstream ss(line);
-    int num;
-    while (ss >> num) {
-        otherSet.insert(num);
-    }
-    
-    MySet* unionSet = mySet.unionWith(otherSet);
-    mySet = *unionSet;
-    delete unionSet;
-    
-    saveSetToFile(mySet, filePath);
-    cout << "Множества объединены" << endl;
+    PendingChanges pending;
+    combineWith(mySet, readNumbersLine(), OP_UNION, pending);
+    flushChanges(mySet, file, pending);
 }
 
 // Функция пересечения множеств
-void SET_INTERSECT(MySet& mySet, const string& filePath) {
+void SET_INTERSECT(MySet& mySet, const SetFile& file) {
     cout << "Введите числа для второго множества через пробел: ";
-    string line;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    getline(cin, line);
-    
-    MySet otherSet;
-    stringstream ss(line);
-    int num;
-    while (ss >> num) {
-        otherSet.insert(num);
-    }
-    
-    MySet* intersectSet = mySet.intersectWith(otherSet);
-    mySet = *intersectSet;
-    delete intersectSet;
-    
-    saveSetToFile(mySet, filePath);
-    cout << "Найдено пересечение множеств" << endl;
+    PendingChanges pending;
+    combineWith(mySet, readNumbersLine(), OP_INTERSECT, pending);
+    flushChanges(mySet, file, pending);
 }
 
 // Функция разности множеств
-void SET_DIFFERENCE(MySet& mySet, const string& filePath) {
+void SET_DIFFERENCE(MySet& mySet, const SetFile& file) {
     cout << "Введите числа для второго множества через пробел: ";
-    string line;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    getline(cin, line);
-    
-    MySet otherSet;
-    stringstream ss(line);
-    int num;
-    while (ss >> num) {
-        otherSet.insert(num);
-    }
-    
-    MySet* diffSet = mySet.differenceWith(otherSet);
-    mySet = *diffSet;
-    delete diffSet;
-    
-    saveSetToFile(mySet, filePath);
-    cout << "Выполнена разность множеств" << endl;
+    PendingChanges pending;
+    combineWith(mySet, readNumbersLine(), OP_DIFFERENCE, pending);
+    flushChanges(mySet, file, pending);
 }
 
 // Функция проверки на подмножество
 void SET_SUBSET(const MySet& mySet) {
     cout << "Введите числа для проверки на подмножество через пробел: ";
-    string line;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    getline(cin, line);
-    
-    MySet otherSet;
-    stringstream ss(line);
+    checkSubset(mySet, readNumbersLine());
+}
+
+// Функция подсчёта элементов в отрезке
+void SET_RANGE(const MySet& mySet) {
+    cout << "Введите границы отрезка через пробел: ";
+    int from, to;
+    cin >> from >> to;
+    countRange(mySet, from, to);
+}
+
+// Функция вывода ранга числа
+void SET_RANK(const MySet& mySet) {
+    cout << "Введите число: ";
     int num;
-    while (ss >> num) {
-        otherSet.insert(num);
+    cin >> num;
+    printRank(mySet, num);
+}
+
+// Функция вывода k-го по возрастанию элемента
+void SET_KTH(const MySet& mySet) {
+    cout << "Введите номер элемента (с 1): ";
+    int k;
+    cin >> k;
+    printKth(mySet, k);
+}
+
+// Функция экспорта множества в другой файл (формат задаётся --format, по умолчанию текст)
+void SET_EXPORT(const MySet& mySet, SetFileFormat format) {
+    cout << "Введите путь к файлу для экспорта: ";
+    string path;
+    cin >> path;
+    SetFile target;
+    target.path = path;
+    target.format = format;
+    if (saveSetToFile(mySet, target)) {
+        cout << "Множество сохранено в " << path << endl;
     }
-    
-    if (mySet.isSubsetOf(otherSet)) {
-        cout << "Текущее множество является подмножеством введенного" << endl;
-    } else {
-        cout << "Текущее множество НЕ является подмножеством введенного" << endl;
+}
+
+// Ответ на запрос прямо по двоичному файлу (с учётом журнала), без построения
+// множества. Возвращает false, если так выполнить запрос нельзя
+bool mappedQuery(const string& query, const string& filePath) {
+    if (query != "SET_AT" && query != "SET_SIZE" && query != "SET_SUM" && query != "SET_MIN" && query != "SET_MAX" &&
+        query != "SET_RANGE" && query != "SET_RANK" && query != "SET_KTH") {
+        return false;
+    }
+    SetFileView view;
+    if (!view.open(filePath)) {
+        return false;
+    }
+
+    if (query == "SET_AT") {
+        cout << "Введите число для проверки: ";
+        int num;
+        cin >> num;
+        if (view.contains(num))
+            cout << num << " присутствует\n";
+        else
+            cout << num << " отсутствует\n";
+    }
+    else if (query == "SET_SIZE") {
+        cout << "Размер множества: " << view.size() << endl;
+    }
+    else if (query == "SET_SUM") {
+        cout << "Сумма элементов: " << view.sum() << endl;
+    }
+    else if (query == "SET_RANGE") {
+        cout << "Введите границы отрезка через пробел: ";
+        int from, to;
+        cin >> from >> to;
+        uint64_t inRange = from > to ? 0 : view.rank(to) - view.rank(from) + (view.contains(to) ? 1 : 0);
+        cout << "Элементов в отрезке [" << from << ", " << to << "]: " << inRange << endl;
+    }
+    else if (query == "SET_RANK") {
+        cout << "Введите число: ";
+        int num;
+        cin >> num;
+        cout << "Элементов меньше " << num << ": " << view.rank(num) << endl;
+    }
+    else if (query == "SET_KTH") {
+        cout << "Введите номер элемента (с 1): ";
+        int k;
+        cin >> k;
+        if (k < 1 || (uint64_t)k > view.size())
+            cout << "Нет элемента с номером " << k << endl;
+        else
+            cout << k << "-й по возрастанию элемент: " << view.kth(k - 1) << endl;
+    }
+    else {
+        int value;
+        if (!view.extreme(query == "SET_MAX", value))
+            cout << "Множество пусто" << endl;
+        else if (query == "SET_MIN")
+            cout << "Минимальный элемент: " << value << endl;
+        else
+            cout << "Максимальный элемент: " << value << endl;
+    }
+    return true;
+}
+
+// ---------- Пакетный режим ----------
+
+// Выполнение потока команд с операндами в той же строке ("SETADD 1 2 3",
+// "SET_AT 5"). Множество остаётся в памяти, а изменения записываются в файл
+// каждые flushEvery команд (0 — только в конце)
+void runScript(istream& in, MySet& mySet, const SetFile& file, size_t flushEvery) {
+    PendingChanges pending;
+    string line;
+    size_t executed = 0;
+    while (getline(in, line)) {
+        stringstream ss(line);
+        string command;
+        if (!(ss >> command) || command[0] == '#') {
+            continue; // Пустые строки и комментарии
+        }
+        string rest;
+        getline(ss, rest);
+        vector<int> numbers = parseNumbers(rest);
+
+        if (command == "SETADD") addElements(mySet, numbers, pending);
+        else if (command == "SETDEL") removeElements(mySet, numbers, pending);
+        else if (command == "SET_AT") {
+            for (int num : numbers) checkElement(mySet, num);
+        }
+        else if (command == "SET_SIZE") SET_SIZE(mySet);
+        else if (command == "SET_PRINT") SET_PRINT(mySet);
+        else if (command == "SET_CLEAR") clearSet(mySet, pending);
+        else if (command == "SET_SUM") SET_SUM(mySet);
+        else if (command == "SET_MAX") SET_MAX(mySet);
+        else if (command == "SET_MIN") SET_MIN(mySet);
+        else if (command == "SET_UNION") combineWith(mySet, numbers, OP_UNION, pending);
+        else if (command == "SET_INTERSECT") combineWith(mySet, numbers, OP_INTERSECT, pending);
+        else if (command == "SET_DIFFERENCE") combineWith(mySet, numbers, OP_DIFFERENCE, pending);
+        else if (command == "SET_SUBSET") checkSubset(mySet, numbers);
+        else if (command == "SET_RANGE") {
+            if (numbers.size() == 2) countRange(mySet, numbers[0], numbers[1]);
+            else cerr << "SET_RANGE: нужны две границы отрезка\n";
+        }
+        else if (command == "SET_RANK") {
+            for (int num : numbers) printRank(mySet, num);
+        }
+        else if (command == "SET_KTH") {
+            for (int k : numbers) printKth(mySet, k);
+        }
+        else if (command == "FLUSH") flushChanges(mySet, file, pending);
+        else {
+            cerr << "Неизвестная операция: " << command << "\n";
+            continue;
+        }
+
+        executed++;
+        if (flushEvery > 0 && executed % flushEvery == 0) {
+            flushChanges(mySet, file, pending);
+        }
     }
+    flushChanges(mySet, file, pending);
 }
 
 void printHelp() {
@@ -485,37 +2935,481 @@ void printHelp() {
     cout << "  SET_INTERSECT - найти пересечение с другим множеством" << endl;
     cout << "  SET_DIFFERENCE - найти разность с другим множеством" << endl;
     cout << "  SET_SUBSET  - проверить на подмножество" << endl;
+    cout << "  SET_RANGE   - количество элементов в отрезке [a, b]" << endl;
+    cout << "  SET_RANK    - количество элементов меньше числа" << endl;
+    cout << "  SET_KTH     - k-й по возрастанию элемент" << endl;
+    cout << "  SET_EXPORT  - сохранить множество в другой файл (формат --format)" << endl;
+    cout << "В пакетном режиме (--script) операнды пишутся в строке команды:" << endl;
+    cout << "  SETADD 1 2 3, SET_AT 5, SET_RANGE 1 9; FLUSH - записать изменения" << endl;
+}
+
+// Разбор названия хранилища из командной строки
+bool parseBackend(const string& name, SetBackend& backend) {
+    if (name == "list") backend = BACKEND_LIST;
+    else if (name == "hash") backend = BACKEND_HASH;
+    else if (name == "bitmap") backend = BACKEND_BITMAP;
+    else if (name == "sorted") backend = BACKEND_SORTED;
+    else return false;
+    return true;
+}
+
+// Разбор названия формата файла из командной строки
+bool parseFormat(const string& name, SetFileFormat& format) {
+    if (name == "text") format = FORMAT_TEXT;
+    else if (name == "binary") format = FORMAT_BINARY;
+    else return false;
+    return true;
+}
+
+// Неотрицательное целое значение параметра; false для "abc", "-1" и т.п.
+bool parseCount(const string& text, size_t& value) {
+    if (text.empty() || !all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    try {
+        value = stoul(text);
+    } catch (const out_of_range&) {
+        return false;
+    }
+    return true;
+}
+
+// ---------- Замер производительности ----------
+
+// Накопитель результатов, чтобы компилятор не выбросил замеряемые циклы
+static size_t benchSink = 0;
+
+// Секунды, прошедшие с момента start
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Файл из n различных случайных чисел; сами числа возвращаются в values
+static void writeBenchFile(const string& path, size_t n, vector<int>& values, mt19937& rng) {
+    values.resize(n);
+    for (size_t i = 0; i < n; i++) values[i] = (int)(i * 2);  // Чётные — присутствуют
+    shuffle(values.begin(), values.end(), rng);
+    ofstream out(path);
+    for (int x : values) out << x << " ";
+}
+
+// Время загрузки файла и задержка поиска для разных хранилищ
+static void benchLoadAndLookup(const string& path, mt19937& rng) {
+    const char* names[] = {"list", "hash", "bitmap", "sorted"};
+    const size_t listLimit = 100000;                 // Дальше список грузится часами
+    cout << "Загрузка и поиск (половина запросов — промахи)" << endl;
+    cout << "элементов   хранилище   загрузка, с   поиск, нс" << endl;
+    for (size_t n = 1000; n <= 10000000; n *= 10) {
+        vector<int> values;
+        writeBenchFile(path, n, values, rng);
+        vector<int> queries(200000);
+        for (int& q : queries) q = (int)(rng() % (2 * n));
+        for (int b = 0; b < 4; b++) {
+            SetBackend backend = (SetBackend)b;
+            if (backend == BACKEND_LIST && n > listLimit) {
+                printf("%-11zu %-11s %13s %11s\n", n, names[b], "-", "-");
+                continue;
+            }
+            auto start = chrono::steady_clock::now();
+            MySet mySet = loadSetFromFile(path, backend);
+            double loadSec = secondsSince(start);
+
+            size_t lookups = backend == BACKEND_LIST ? std::min<size_t>(queries.size(), 20000000 / n + 1) : queries.size();
+            size_t found = 0;
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < lookups; i++) found += mySet.contains(queries[i]);
+            double lookupNs = secondsSince(start) * 1e9 / lookups;
+            benchSink += found;
+            printf("%-11zu %-11s %13.4f %11.1f\n", n, names[b], loadSec, lookupNs);
+        }
+    }
+}
+
+// Построение, обход и удаление цепочки узлов: отдельный new на каждый узел
+// против пула слэбов, которым пользуется ListStorage
+static void benchNodeAllocation() {
+    cout << endl << "Память под узлы списка: new/delete на узел против пула" << endl;
+    cout << "узлов       способ   выделений   построение, с   обход, с   удаление, с" << endl;
+    for (size_t n = 100000; n <= 10000000; n *= 10) {
+        for (int pooled = 0; pooled < 2; pooled++) {
+            NodePool pool;
+            Node* head = nullptr;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < n; i++) {
+                Node* node = pooled ? pool.allocate((int)i) : new Node((int)i);
+                node->next = head;
+                head = node;
+            }
+            double buildSec = secondsSince(start);
+
+            start = chrono::steady_clock::now();
+            long long sum = 0;
+            for (Node* current = head; current != nullptr; current = current->next) sum += current->data;
+            double walkSec = secondsSince(start);
+            benchSink += (size_t)sum;
+
+            size_t allocations = pooled ? pool.slabCount() : n;
+            start = chrono::steady_clock::now();
+            if (pooled) {
+                pool.releaseAll();
+            } else {
+                while (head != nullptr) {
+                    Node* temp = head;
+                    head = head->next;
+                    delete temp;
+                }
+            }
+            double teardownSec = secondsSince(start);
+            printf("%-11zu %-8s %11zu %15.4f %10.4f %13.4f\n", n, pooled ? "пул" : "new",
+                   allocations, buildSec, walkSec, teardownSec);
+        }
+    }
+}
+
+// Скорость разбора текстового файла чисел: operator>> против блочного
+// чтения с parseIntTokens, а также разбор уже прочитанного в память текста
+static void benchParse(const string& path, mt19937& rng) {
+    const size_t n = 10000000;
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < n; i++) out << (int)rng() << (i % 16 == 15 ? '\n' : ' ');
+    }
+    double gigabytes = (double)filesystem::file_size(path) / 1e9;
+    cout << endl << "Разбор текстового файла из " << n << " чисел (" << gigabytes * 1000 << " МБ)" << endl;
+    cout << "способ                       время, с    ГБ/с" << endl;
+
+    auto start = chrono::steady_clock::now();
+    vector<int> values;
+    {
+        ifstream in(path);
+        int num;
+        while (in >> num) values.push_back(num);
+    }
+    double seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "ifstream >>", seconds, gigabytes / seconds);
+    benchSink += values.size();
+
+    values.clear();
+    ParseReport report;
+    start = chrono::steady_clock::now();
+    readIntegersFromFile(path, values, report);
+    seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "блоки, один проход", seconds, gigabytes / seconds);
+    benchSink += values.size() + report.malformed;
+
+    string text;
+    {
+        ifstream in(path, ios::binary);
+        text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    values.clear();
+    start = chrono::steady_clock::now();
+    parseIntTokens(text.data(), text.data() + text.size(), true, 0, values, report);
+    seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "разбор текста в памяти", seconds, gigabytes / seconds);
+    benchSink += values.size();
+}
+
+// Множество из диапазона [from, from + n) с 10% случайных пропусков
+static MySet denseRange(int from, int n, SetBackend backend, mt19937& rng) {
+    MySet result(backend);
+    result.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (rng() % 10 != 0) result.insert(from + i);
+    }
+    result.optimize();
+    return result;
+}
+
+// Память на элемент и время операций над плотными диапазонами чисел
+static void benchSetAlgebra(mt19937& rng) {
+    const char* names[] = {"list", "hash", "bitmap", "sorted"};
+    cout << endl << "Операции над плотными диапазонами (второе множество сдвинуто на n/2)" << endl;
+    cout << "элементов   хранилище   байт/элемент   объединение, с   пересечение, с   разность, с" << endl;
+    for (int n = 1000000; n <= 10000000; n *= 10) {
+        for (int b = BACKEND_HASH; b <= BACKEND_SORTED; b++) {
+            SetBackend backend = (SetBackend)b;
+            MySet first = denseRange(0, n, backend, rng);
+            MySet second = denseRange(n / 2, n, backend, rng);
+            double times[3];
+            for (int op = 0; op < 3; op++) {
+                auto start = chrono::steady_clock::now();
+                MySet* result = op == 0 ? first.unionWith(second)
+                              : op == 1 ? first.intersectWith(second)
+                              : first.differenceWith(second);
+                times[op] = secondsSince(start);
+                benchSink += result->size();
+                delete result;
+            }
+            printf("%-11d %-11s %14.2f %16.4f %16.4f %13.4f\n", n, names[b],
+                   (double)first.memoryBytes() / first.size(), times[0], times[1], times[2]);
+        }
+    }
+}
+
+// Операции над множествами сильно разного размера: выигрыш галопа
+static void benchSkewed(mt19937& rng) {
+    const int bigSize = 10000000;
+    vector<int> bigValues(bigSize);
+    for (int i = 0; i < bigSize; i++) bigValues[i] = i * 3;
+    cout << endl << "Операции с множеством из " << bigSize << " элементов и малым множеством" << endl;
+    cout << "малое       хранилище   пересечение, с   большое \\ малое, с   малое \\ большое, с   объединение, с" << endl;
+    for (int b = BACKEND_HASH; b <= BACKEND_SORTED; b += BACKEND_SORTED - BACKEND_HASH) {
+        SetBackend backend = (SetBackend)b;
+        MySet big(backend);
+        big.insertAll(bigValues);
+        for (int smallSize = 100; smallSize <= 1000000; smallSize *= 100) {
+            vector<int> smallValues(smallSize);
+            for (int& x : smallValues) x = (int)(rng() % (3u * bigSize));
+            MySet small(backend);
+            small.insertAll(smallValues);
+
+            double times[4];
+            for (int op = 0; op < 4; op++) {
+                auto start = chrono::steady_clock::now();
+                MySet* result = op == 0 ? small.intersectWith(big)
+                              : op == 1 ? big.differenceWith(small)
+                              : op == 2 ? small.differenceWith(big)
+                              : big.unionWith(small);
+                times[op] = secondsSince(start);
+                benchSink += result->size();
+                delete result;
+            }
+            printf("%-11d %-11s %16.4f %19.4f %19.4f %16.4f\n", smallSize, backend == BACKEND_HASH ? "hash" : "sorted",
+                   times[0], times[1], times[2], times[3]);
+        }
+    }
+}
+
+// Ускорение операций над множествами с ростом числа потоков
+static void benchParallel(mt19937& rng) {
+    const int n = 20000000;
+    unsigned maxThreads = std::max(1u, thread::hardware_concurrency());
+    unsigned savedThreads = algebraThreads;
+    cout << endl << "Параллельные операции над множествами из " << n << " элементов (до " << maxThreads << " потоков)" << endl;
+    cout << "хранилище   потоков   объединение, с   пересечение, с   разность, с   ускорение" << endl;
+    for (int b = BACKEND_HASH; b <= BACKEND_SORTED; b++) {
+        SetBackend backend = (SetBackend)b;
+        const char* name = backend == BACKEND_HASH ? "hash" : backend == BACKEND_BITMAP ? "bitmap" : "sorted";
+        vector<int> values(n);
+        MySet first(backend), second(backend);
+        for (int& x : values) x = (int)(rng() % (4u * n));
+        first.insertAll(values);
+        for (int& x : values) x = (int)(rng() % (4u * n));
+        second.insertAll(values);
+        first.optimize();
+        second.optimize();
+
+        double baseline = 0;
+        for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            algebraThreads = threads;
+            double times[3];
+            for (int op = 0; op < 3; op++) {
+                auto start = chrono::steady_clock::now();
+                MySet* result = op == 0 ? first.unionWith(second)
+                              : op == 1 ? first.intersectWith(second)
+                              : first.differenceWith(second);
+                times[op] = secondsSince(start);
+                benchSink += result->size();
+                delete result;
+            }
+            double total = times[0] + times[1] + times[2];
+            if (threads == 1) baseline = total;
+            printf("%-11s %-9u %16.4f %16.4f %13.4f %11.2f\n", name, threads, times[0], times[1], times[2], baseline / total);
+            if (threads == maxThreads) break;
+        }
+    }
+    algebraThreads = savedThreads;
+}
+
+#ifdef __linux__
+// Значение поля вида "VmRSS:  1234 kB" из /proc/self/status, в мегабайтах
+static double procStatusMb(const string& field) {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, field.size(), field) == 0) return stod(line.substr(field.size() + 1)) / 1024;
+    }
+    return -1;
+}
+#endif
+
+// Прирост пиковой памяти при операции над двумя множествами по 20 млн:
+// результат через unionWith и присваивание (как раньше в SET_UNION) против
+// операций на месте в одном потоке и на всех ядрах (параллельный путь тоже
+// считает на месте и не должен поднимать пик). Каждый замер идёт в отдельном
+// процессе, где пик памяти сбрасывается перед операцией (Linux, /proc/self/clear_refs)
+static void benchInPlace() {
+#ifdef __linux__
+    const int n = 20000000;
+    const char* opNames[] = {"объединение", "пересечение", "разность"};
+    unsigned maxThreads = std::max(1u, thread::hardware_concurrency());
+    cout << endl << "Пик памяти при операциях над множествами из " << n << " элементов" << endl;
+    cout << "хранилище   операция      способ      потоков   время, с   прирост пика, МБ" << endl;
+    for (int b = BACKEND_BITMAP; b <= BACKEND_SORTED; b++) {
+        for (int op = 0; op < 3; op++) {
+            for (int method = 0; method < 3; method++) {   // Копия; на месте; на месте, все потоки
+                bool inPlace = method > 0;
+                unsigned threads = method == 1 ? 1 : maxThreads;
+                if (method == 2 && maxThreads == 1) continue;
+                cout.flush();
+                pid_t pid = fork();
+                if (pid < 0) return;
+                if (pid > 0) {
+                    waitpid(pid, nullptr, 0);
+                    continue;
+                }
+                mt19937 rng(777);
+                algebraThreads = threads;
+                MySet first((SetBackend)b), second((SetBackend)b);
+                {
+                    vector<int> values(n);
+                    for (int& x : values) x = (int)(rng() % (4u * n));
+                    first.insertAll(values);
+                    for (int& x : values) x = (int)(rng() % (4u * n));
+                    second.insertAll(values);
+                }
+                ofstream("/proc/self/clear_refs") << "5";
+                double before = procStatusMb("VmRSS");
+                auto start = chrono::steady_clock::now();
+                if (inPlace) {
+                    if (op == 0) first.unionInPlace(second);
+                    else if (op == 1) first.intersectInPlace(second);
+                    else first.subtractInPlace(second);
+                } else {
+                    MySet* result = op == 0 ? first.unionWith(second)
+                                  : op == 1 ? first.intersectWith(second)
+                                  : first.differenceWith(second);
+                    first = *result;
+                    delete result;
+                }
+                double seconds = secondsSince(start);
+                printf("%-11s %-13s %-11s %-9u %8.4f %18.1f\n", b == BACKEND_BITMAP ? "bitmap" : "sorted", opNames[op],
+                       inPlace ? "на месте" : "копия", threads, seconds, procStatusMb("VmHWM") - before);
+                fflush(stdout);
+                _exit(0);
+            }
+        }
+    }
+#endif
+}
+
+void runBenchmark() {
+    mt19937 rng(12345);
+    string path = (filesystem::temp_directory_path() / "myset_bench.txt").string();
+    benchLoadAndLookup(path, rng);
+    benchParse(path, rng);
+    benchNodeAllocation();
+    benchSetAlgebra(rng);
+    benchSkewed(rng);
+    benchParallel(rng);
+    benchInPlace();
+    remove(path.c_str());
+}
+
+void printUsage() {
+    cerr << "Использование: ./program --file <файл> --query <операция> [--backend list|hash|bitmap|sorted]\n"; 
+    cerr << "                                                           [--format text|binary]\n";
+    cerr << "                                                           [--journal] [--compact-after N]\n";
+    cerr << "                                                           [--threads N]\n";
+    cerr << "Пакетный режим: ./program --file <файл> --script <файл|-> [--flush-every N]\n";
+    cerr << "Пример: ./program --file data.txt --query SETADD\n";
+    cerr << "Для справки: ./program --file data.txt --query HELP\n";
+    cerr << "Замер производительности: ./program --bench\n";
 }
 
 int main(int argc, char* argv[]) {
-    // Проверка количества аргументов командной строки
-    if (argc != 5) { 
-        cerr << "Использование: ./program --file <файл> --query <операция>\n"; 
-        cerr << "Пример: ./program --file data.txt --query SETADD\n";
-        cerr << "Для справки: ./program --file data.txt --query HELP\n";
+    string filePath;
+    string query;
+    SetBackend backend = BACKEND_LIST;
+    SetFileFormat format = FORMAT_TEXT;
+    bool formatGiven = false;
+    bool journal = false;
+    size_t compactRecords = JOURNAL_COMPACT_RECORDS;
+    string scriptPath;
+    size_t flushEvery = 0;
+    size_t threads = 1;
+
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            runBenchmark();
+            return 0;
+        }
+        else if (arg == "--file" && i + 1 < argc) filePath = argv[++i];
+        else if (arg == "--query" && i + 1 < argc) query = argv[++i];
+        else if (arg == "--backend" && i + 1 < argc && parseBackend(argv[i + 1], backend)) i++;
+        else if (arg == "--script" && i + 1 < argc) scriptPath = argv[++i];
+        else if (arg == "--flush-every" && i + 1 < argc && parseCount(argv[i + 1], flushEvery)) i++;
+        else if (arg == "--threads" && i + 1 < argc && parseCount(argv[i + 1], threads)) {
+            i++;
+            algebraThreads = (unsigned)std::min<size_t>(threads, numeric_limits<unsigned>::max());
+            if (algebraThreads == 0) algebraThreads = std::max(1u, thread::hardware_concurrency());
+        }
+        else if (arg == "--journal") journal = true;
+        else if (arg == "--compact-after" && i + 1 < argc && parseCount(argv[i + 1], compactRecords)) i++;
+        else if (arg == "--format" && i + 1 < argc && parseFormat(argv[i + 1], format)) {
+            formatGiven = true;
+            i++;
+        }
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (filePath.empty() || (query.empty() && scriptPath.empty())) { 
+        printUsage();
         return 1; 
     }
 
-    string filePath = argv[2]; 
-    string query = argv[4];    
+    // Запросы только на чтение к двоичному файлу выполняются без загрузки
+    if (mappedQuery(query, filePath)) {
+        return 0;
+    }
+
+    // Без --format файл сохраняется в том формате, в котором был записан
+    SetFile file;
+    file.path = filePath;
+    file.format = formatGiven ? format : (isBinarySetFile(filePath) ? FORMAT_BINARY : FORMAT_TEXT);
+    file.journal = journal;
+    file.compactRecords = compactRecords;
 
     // Загружаем множество из файла
-    MySet mySet = loadSetFromFile(filePath);
+    MySet mySet = loadSetFromFile(filePath, backend);
+
+    if (!scriptPath.empty()) {
+        if (scriptPath == "-") {
+            runScript(cin, mySet, file, flushEvery);
+        } else {
+            ifstream script(scriptPath);
+            if (!script.is_open()) {
+                cerr << "Не удалось открыть файл команд: " << scriptPath << "\n";
+                return 1;
+            }
+            runScript(script, mySet, file, flushEvery);
+        }
+        return 0;
+    }
 
     // Вызов соответствующей функции в зависимости от запроса
-    if (query == "SETADD") SETADD(mySet, filePath);
-    else if (query == "SETDEL") SETDEL(mySet, filePath); 
+    if (query == "SETADD") SETADD(mySet, file);
+    else if (query == "SETDEL") SETDEL(mySet, file); 
     else if (query == "SET_AT") SET_AT(mySet); 
     else if (query == "SET_SIZE") SET_SIZE(mySet);
     else if (query == "SET_PRINT") SET_PRINT(mySet);
-    else if (query == "SET_CLEAR") SET_CLEAR(mySet, filePath);
+    else if (query == "SET_CLEAR") SET_CLEAR(mySet, file);
     else if (query == "SET_SUM") SET_SUM(mySet);
     else if (query == "SET_MAX") SET_MAX(mySet);
     else if (query == "SET_MIN") SET_MIN(mySet);
-    else if (query == "SET_UNION") SET_UNION(mySet, filePath);
-    else if (query == "SET_INTERSECT") SET_INTERSECT(mySet, filePath);
-    else if (query == "SET_DIFFERENCE") SET_DIFFERENCE(mySet, filePath);
+    else if (query == "SET_UNION") SET_UNION(mySet, file);
+    else if (query == "SET_INTERSECT") SET_INTERSECT(mySet, file);
+    else if (query == "SET_DIFFERENCE") SET_DIFFERENCE(mySet, file);
     else if (query == "SET_SUBSET") SET_SUBSET(mySet);
+    else if (query == "SET_RANGE") SET_RANGE(mySet);
+    else if (query == "SET_RANK") SET_RANK(mySet);
+    else if (query == "SET_KTH") SET_KTH(mySet);
+    else if (query == "SET_EXPORT") SET_EXPORT(mySet, formatGiven ? format : FORMAT_TEXT);
     else if (query == "HELP") printHelp();
     else cerr << "Неизвестная операция. Введите HELP для справки.\n"; 
 
@@ -4,6 +4,34 @@
 #include <string>
 #include <vector>
 #include <limits>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <functional>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <random>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -44,11 +72,16 @@ public:
             return false; // Элемент уже существует
         }
         
+        insertNew(value);
+        return true; 
+    }
+    
+    // Добавление элемента, которого заведомо нет в множестве
+    void insertNew(int value) {
         SetNode* newNode = new SetNode(value); // Создаем новый узел
         newNode->next = head; // Новый узел указывает на текущую голову
         head = newNode; 
         count++; 
-        return true; 
     }
     
     // Удаление элемента из множества
@@ -128,23 +161,66 @@ public:
     }
     
     // Вывод всех элементов множества
-    void print() const {
+    void print(ostream& out = cout) const {
         if (count == 0) {
-            cout << "Множество пусто" << endl;
+            out << "Множество пусто" << endl;
             return;
         }
         
         SetNode* current = head;
         while (current != nullptr) {
-            cout << current->data << " ";
+            out << current->data << " ";
             current = current->next;
         }
-        cout << endl;
+        out << endl;
     }
 };
 
+// ---------- Надёжная запись файлов ----------
+
+// Сброс содержимого файла (или каталога) на диск. В Windows не выполняется
+bool syncFile(const string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+// Атомарная замена path уже записанным tmpPath: после сбоя на диске
+// останется либо старое, либо новое содержимое целиком
+bool replaceFile(const string& path, const string& tmpPath) {
+    if (!syncFile(tmpPath)) {
+        return false;
+    }
+    error_code ec;
+    filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        return false;
+    }
+    string dir = filesystem::path(path).parent_path().string();
+    syncFile(dir.empty() ? "." : dir);  // Запись о переименовании в каталоге
+    return true;
+}
+
+// Контрольная сумма FNV-1a
+uint32_t checksum32(const char* data, size_t bytes) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bytes; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
 // Вспомогательные функции для работы с файлами
-string Futext(string& filenm, string& nameStruct) {
+string Futext(const string& filenm, const string& nameStruct) {
     string str, text;
     ifstream fin(filenm);
     
@@ -164,337 +240,2181 @@ string Futext(string& filenm, string& nameStruct) {
     return text;
 }
 
-void writefl(string& filenm, string& text) {
-    ofstream fout(filenm);
+// Файл пишется рядом под временным именем и заменяет старый только целиком
+bool writefl(const string& filenm, const string& text) {
+    string tmpPath = filenm + ".tmp";
+    ofstream fout(tmpPath, ios::binary);
     if (!fout.is_open()) {
         cout << "Ошибка открытия файла для записи" << endl;
-        return;
+        return false;
     }
     fout << text;
     fout.close();
+    if (!fout || !replaceFile(filenm, tmpPath)) {
+        cout << "Ошибка записи файла " << filenm << endl;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
 }
 
-// Чтение множества из файла
-Set loadSetFromFile(string& filenm, string& nameStruct) {
-    Set mySet;
-    ifstream inFile(filenm);
-    
-    if (!inFile.is_open()) {
-        return mySet;
-    }
-    
-    string str;
-    while (getline(inFile, str)) {
-        stringstream ss(str);
-        string tokens;
-        getline(ss, tokens, ' ');
-        if (tokens == nameStruct) {
-            while (getline(ss, tokens, ' ')) {
-                if (!tokens.empty()) {
-                    try {
-                        mySet.insert(stoi(tokens));
-                    } catch (...) {
-                        // Пропускаем некорректные значения
-                    }
-                }
-            }
-        }
-    }
-    inFile.close();
-    return mySet;
+// ---------- Быстрый разбор чисел ----------
+//
+// Текстовый файл читается блоками по PARSE_CHUNK_BYTES, строки разбираются
+// прямо в буфере за один проход по символам, без потоков ввода и
+// исключений. Некорректные лексемы пропускаются и подсчитываются в ParseReport
+
+const size_t PARSE_CHUNK_BYTES = 1 << 22;
+
+// ParseReport, isSeparator и parseIntTokens дословно повторяются в 2set.cpp:
+// программы собираются по отдельности. Копии меняются только вместе
+
+// Итог разбора: сколько лексем отброшено и какая была первой
+struct ParseReport {
+    size_t malformed = 0;
+    string firstMalformed;
+    size_t firstOffset = 0;      // Смещение первой некорректной лексемы в тексте
+};
+
+inline bool isSeparator(char c) {
+    return (unsigned char)c <= ' ';  // Пробел, перевод строки, табуляция и прочие управляющие
 }
 
-// Функция добавления элементов в множество
-void SETADD(string& name, string& filenm, string& value) {
-    string textfull = Futext(filenm, name);
-    Set mySet = loadSetFromFile(filenm, name);
-    
-    try {
-        int num = stoi(value);
-        if (mySet.insert(num)) {
-            string str = name + " " + mySet.toString();
-            textfull += str;
-            writefl(filenm, textfull);
-            cout << "Элемент " << num << " добавлен в множество '" << name << "'" << endl;
+// Разбор чисел, разделённых пробельными символами, в [p, end). offset —
+// смещение p от начала всего текста. Если final == false, лексема,
+// упирающаяся в end, может продолжаться в следующем блоке: она не
+// разбирается, а возвращается позиция её начала
+const char* parseIntTokens(const char* p, const char* end, bool final, size_t offset,
+                           vector<int>& out, ParseReport& report) {
+    const char* begin = p;
+    while (true) {
+        while (p != end && isSeparator(*p)) p++;
+        if (p == end) return end;
+        const char* token = p;
+
+        // Цифры накапливаются в 64 бита тем же проходом, что ищет конец
+        // лексемы; переполнение int32 проверяется один раз в конце
+        bool negative = *p == '-';
+        p += negative || *p == '+';           // Как и operator>>, допускаем "+5"
+        const char* digits = p;
+        while (p != end && *p == '0') p++;   // Ведущие нули не считаются в длину
+        const char* significant = p;
+        uint64_t value = 0;
+        unsigned digit;
+        while (p != end && (digit = (unsigned char)*p - '0') < 10) {
+            value = value * 10 + digit;
+            p++;
+        }
+        bool valid = p != digits && p - significant <= 10 && value <= 2147483647u + (uint64_t)negative
+                     && (p == end || isSeparator(*p));
+        while (p != end && !isSeparator(*p)) p++;
+        if (p == end && !final) return token;
+
+        if (valid) {
+            out.push_back(negative ? (int)(0 - value) : (int)value);
         } else {
-            cout << "Элемент " << num << " уже существует в множестве" << endl;
+            if (report.malformed++ == 0) {
+                report.firstMalformed.assign(token, std::min<size_t>(p - token, 32));
+                report.firstOffset = offset + (token - begin);
+            }
         }
-    } catch (...) {
-        cout << "Ошибка: некорректное значение" << endl;
     }
 }
 
-// Функция удаления элементов из множества
-void SETDEL(string& name, string& filenm, string& value) {
-    string textfull = Futext(filenm, name);
-    Set mySet = loadSetFromFile(filenm, name);
-    
-    try {
-        int num = stoi(value);
-        if (mySet.erase(num)) {
-            string str = name + " " + mySet.toString();
-            textfull += str;
-            writefl(filenm, textfull);
-            cout << "Элемент " << num << " удален из множества '" << name << "'" << endl;
-        } else {
-            cout << "Элемент " << num << " не найден в множестве" << endl;
-        }
-    } catch (...) {
-        cout << "Ошибка: некорректное значение" << endl;
+// Разбор одного числа из строки запроса
+bool parseInt(const string& token, int& value) {
+    vector<int> out;
+    ParseReport report;
+    parseIntTokens(token.data(), token.data() + token.size(), true, 0, out, report);
+    if (out.size() != 1 || report.malformed != 0) {
+        return false;
     }
+    value = out[0];
+    return true;
 }
 
-// Функция проверки наличия элемента в множестве
-void SET_AT(string& name, string& filenm, string& value) {
-    Set mySet = loadSetFromFile(filenm, name);
-    
-    try {
-        int num = stoi(value);
-        if (mySet.contains(num)) {
-            cout << "True" << endl;
-        } else {
-            cout << "False" << endl;
+// Проход по строкам текстового файла блоками: незаконченная строка в конце
+// блока переносится в начало следующего, а если строка длиннее блока, блок
+// растёт. onLine получает [начало, конец) строки без перевода строки.
+// false, если файл не открылся
+template<typename OnLine>
+bool forEachLine(const string& filenm, OnLine onLine) {
+    ifstream inFile(filenm, ios::binary);
+    if (!inFile.is_open()) {
+        return false;
+    }
+    vector<char> buffer(PARSE_CHUNK_BYTES);
+    size_t carry = 0;        // Незаконченная строка из прошлого блока в начале буфера
+    while (true) {
+        if (carry == buffer.size()) buffer.resize(buffer.size() * 2);
+        inFile.read(buffer.data() + carry, buffer.size() - carry);
+        size_t filled = carry + (size_t)inFile.gcount();
+        bool final = filled < buffer.size();
+        const char* line = buffer.data();
+        const char* end = line + filled;
+        const char* lineEnd;
+        while ((lineEnd = static_cast<const char*>(memchr(line, '\n', end - line))) != nullptr) {
+            onLine(line, lineEnd);
+            line = lineEnd + 1;
         }
-    } catch (...) {
-        cout << "Ошибка: некорректное значение" << endl;
+        if (final) {
+            if (line != end) onLine(line, end);
+            return true;
+        }
+        carry = end - line;
+        memmove(buffer.data(), line, carry);
     }
 }
 
-// Функция вывода размера множества
-void SET_SIZE(string& name, string& filenm) {
-    Set mySet = loadSetFromFile(filenm, name);
-    cout << mySet.size() << endl;
+// Всё содержимое файла одним чтением; false, если файл не открылся
+bool readWholeFile(const string& filenm, string& text) {
+    ifstream inFile(filenm, ios::binary | ios::ate);
+    if (!inFile.is_open()) {
+        return false;
+    }
+    text.resize((size_t)inFile.tellg());
+    inFile.seekg(0);
+    inFile.read(&text[0], text.size());
+    text.resize((size_t)inFile.gcount());
+    return true;
 }
 
-// Функция вывода всех элементов множества
-void SET_PRINT(string& name, string& filenm) {
-    Set mySet = loadSetFromFile(filenm, name);
-    mySet.print();
-}
+// ---------- Хранилища именованных множеств ----------
 
-// Функция очистки множества
-void SET_CLEAR(string& name, string& filenm) {
-    string textfull = Futext(filenm, name);
-    writefl(filenm, textfull);
-    cout << "Множество '" << name << "' очищено" << endl;
-}
+// Общий интерфейс хранилища: команды работают с множествами по имени и не
+// знают, как они лежат в файле
+class SetStore {
+public:
+    virtual ~SetStore() {}
+    // Элементы множества name; false, если такого множества нет
+    virtual bool load(const string& name, vector<int>& elements) = 0;
+    // Создание или замена множества
+    virtual void save(const string& name, const vector<int>& elements) = 0;
+    virtual void remove(const string& name) = 0;
+    virtual vector<string> names() = 0;
 
-// Функция вывода суммы элементов множества
-void SET_SUM(string& name, string& filenm) {
-    Set mySet = loadSetFromFile(filenm, name);
-    cout << mySet.sum() << endl;
-}
+    // Набор изменений сразу: nullptr вместо элементов — удаление множества.
+    // false, если изменения не удалось записать
+    virtual bool applyChanges(const map<string, const vector<int>*>& changes) {
+        for (const auto& change : changes) {
+            if (change.second != nullptr) save(change.first, *change.second);
+            else remove(change.first);
+        }
+        return true;
+    }
 
-// Функция создания пустого множества
-void SET_CREATE(string& name, string& filenm) {
-    string textfull = Futext(filenm, name);
-    string str = name;
-    textfull += str + "\n";
-    writefl(filenm, textfull);
-    cout << "Множество '" << name << "' создано" << endl;
-}
+    // Перечитать служебные данные, которые могли изменить другие процессы
+    virtual void refresh() {}
+};
 
-// Функция объединения двух множеств
-void SET_UNION(string& name1, string& name2, string& resultName, string& filenm) {
-    string textfull = Futext(filenm, resultName);
-    Set set1 = loadSetFromFile(filenm, name1);
-    Set set2 = loadSetFromFile(filenm, name2);
-    
-    // Создаем объединение
-    Set resultSet;
-    
-    // Добавляем элементы из первого множества
-    vector<int> elements1;
-    set1.getElements(elements1);
-    for (int elem : elements1) {
-        resultSet.insert(elem);
-    }
-    
-    // Добавляем элементы из второго множества
-    vector<int> elements2;
-    set2.getElements(elements2);
-    for (int elem : elements2) {
-        resultSet.insert(elem);
+// Строка "имя e1 e2 ..." текстового формата
+string formatSetLine(const string& name, const vector<int>& elements) {
+    string line = name;
+    for (int x : elements) {
+        line += " " + to_string(x);
     }
-    
-    string str = resultName + " " + resultSet.toString();
-    textfull += str;
-    writefl(filenm, textfull);
-    cout << "Объединение множеств '" << name1 << "' и '" << name2 
-         << "' сохранено в '" << resultName << "'" << endl;
+    return line + "\n";
 }
 
-// Функция пересечения двух множеств
-void SET_INTERSECT(string& name1, string& name2, string& resultName, string& filenm) {
-    string textfull = Futext(filenm, resultName);
-    Set set1 = loadSetFromFile(filenm, name1);
-    Set set2 = loadSetFromFile(filenm, name2);
-    
-    // Создаем пересечение
-    Set resultSet;
-    
-    // Находим общие элементы
-    vector<int> elements1;
-    set1.getElements(elements1);
-    for (int elem : elements1) {
-        if (set2.contains(elem)) {
-            resultSet.insert(elem);
+// Текстовый формат: одна строка на множество. Любое чтение разбирает весь
+// файл, любое изменение переписывает его целиком
+class TextStore : public SetStore {
+private:
+    string filenm;
+
+public:
+    explicit TextStore(const string& path) : filenm(path) {}
+
+    bool load(const string& name, vector<int>& elements) override {
+        elements.clear();
+        
+        // Строка файла: имя множества, пробел, элементы через пробел
+        bool found = false;
+        ParseReport report;
+        bool opened = forEachLine(filenm, [&](const char* line, const char* lineEnd) {
+            const char* nameEnd = static_cast<const char*>(memchr(line, ' ', lineEnd - line));
+            if (nameEnd == nullptr) nameEnd = lineEnd;
+            if ((size_t)(nameEnd - line) == name.size() && memcmp(line, name.data(), name.size()) == 0) {
+                parseIntTokens(nameEnd, lineEnd, true, nameEnd - line, elements, report);
+                found = true;
+            }
+        });
+        if (!opened) {
+            return false;
         }
+        if (report.malformed != 0) {
+            cerr << "Множество '" << name << "': пропущено некорректных значений: " << report.malformed
+                 << " (первое \"" << report.firstMalformed << "\" на позиции " << report.firstOffset
+                 << " в строке множества)" << endl;
+        }
+        return found;
     }
-    
-    string str = resultName + " " + resultSet.toString();
-    textfull += str;
-    writefl(filenm, textfull);
-    cout << "Пересечение множеств '" << name1 << "' и '" << name2 
-         << "' сохранено в '" << resultName << "'" << endl;
-}
 
-// Функция разности двух множеств
-void SET_DIFFERENCE(string& name1, string& name2, string& resultName, string& filenm) {
-    string textfull = Futext(filenm, resultName);
-    Set set1 = loadSetFromFile(filenm, name1);
-    Set set2 = loadSetFromFile(filenm, name2);
-    
-    // Создаем разность
-    Set resultSet;
-    
-    // Находим элементы, которые есть в первом, но нет во втором
-    vector<int> elements1;
-    set1.getElements(elements1);
-    for (int elem : elements1) {
-        if (!set2.contains(elem)) {
-            resultSet.insert(elem);
+    void save(const string& name, const vector<int>& elements) override {
+        string textfull = Futext(filenm, name);
+        textfull += formatSetLine(name, elements);
+        writefl(filenm, textfull);
+    }
+
+    void remove(const string& name) override {
+        string textfull = Futext(filenm, name);
+        writefl(filenm, textfull);
+    }
+
+    // Все изменения за одно чтение и одну запись файла
+    bool applyChanges(const map<string, const vector<int>*>& changes) override {
+        string textfull;
+        ifstream fin(filenm);
+        string str;
+        while (getline(fin, str)) {
+            if (changes.count(str.substr(0, str.find(' '))) == 0) {
+                textfull += str + "\n";
+            }
         }
+        fin.close();
+        for (const auto& change : changes) {
+            if (change.second != nullptr) textfull += formatSetLine(change.first, *change.second);
+        }
+        return writefl(filenm, textfull);
     }
-    
-    string str = resultName + " " + resultSet.toString();
-    textfull += str;
-    writefl(filenm, textfull);
-    cout << "Разность множеств '" << name1 << "' и '" << name2 
-         << "' сохранена в '" << resultName << "'" << endl;
-}
 
-// Обработка команд для множеств
-void setMenu(string& command, string& filenm) {
-    string name, name2, resultName, value;
-    
-    if (command.substr(0, 7) == "SETADD ") {
-        string cons = command.substr(7);
-        stringstream stream(cons);
-        stream >> name >> value;
-        SETADD(name, filenm, value);
-    } 
-    else if (command.substr(0, 7) == "SETDEL ") {
-        string cons = command.substr(7);
-        stringstream stream(cons);
-        stream >> name >> value;
-        SETDEL(name, filenm, value);
-    } 
-    else if (command.substr(0, 7) == "SET_AT ") {
-        string cons = command.substr(7);
-        stringstream stream(cons);
-        stream >> name >> value;
-        SET_AT(name, filenm, value);
-    } 
-    else if (command.substr(0, 8) == "SETSIZE ") {
-        string cons = command.substr(8);
-        stringstream stream(cons);
-        stream >> name;
-        SET_SIZE(name, filenm);
-    } 
-    else if (command.substr(0, 8) == "SETPRINT ") {
-        string cons = command.substr(8);
-        stringstream stream(cons);
-        stream >> name;
-        SET_PRINT(name, filenm);
-    } 
-    else if (command.substr(0, 9) == "SETCLEAR ") {
-        string cons = command.substr(9);
-        stringstream stream(cons);
-        stream >> name;
-        SET_CLEAR(name, filenm);
-    } 
-    else if (command.substr(0, 7) == "SETSUM ") {
-        string cons = command.substr(7);
-        stringstream stream(cons);
-        stream >> name;
-        SET_SUM(name, filenm);
-    } 
-    else if (command.substr(0, 9) == "SETCREATE ") {
-        string cons = command.substr(9);
-        stringstream stream(cons);
-        stream >> name;
-        SET_CREATE(name, filenm);
-    } 
-    else if (command.substr(0, 8) == "SETUNION ") {
-        string cons = command.substr(8);
-        stringstream stream(cons);
-        stream >> name >> name2 >> resultName;
-        SET_UNION(name, name2, resultName, filenm);
-    } 
-    else if (command.substr(0, 11) == "SETINTERSECT ") {
-        string cons = command.substr(11);
-        stringstream stream(cons);
-        stream >> name >> name2 >> resultName;
-        SET_INTERSECT(name, name2, resultName, filenm);
-    } 
-    else if (command.substr(0, 12) == "SETDIFFERENCE ") {
-        string cons = command.substr(12);
-        stringstream stream(cons);
-        stream >> name >> name2 >> resultName;
-        SET_DIFFERENCE(name, name2, resultName, filenm);
-    } 
-    else {
-        cout << "Ошибка. Неизвестная команда для множества: " << command << endl;
-        cout << "Доступные команды: SETADD, SETDEL, SET_AT, SETSIZE, SETPRINT, SETCLEAR, SETSUM, SETCREATE, SETUNION, SETINTERSECT, SETDIFFERENCE" << endl;
+    vector<string> names() override {
+        vector<string> result;
+        ifstream fin(filenm);
+        string str;
+        while (getline(fin, str)) {
+            string name = str.substr(0, str.find(' '));
+            if (!name.empty() && find(result.begin(), result.end(), name) == result.end()) {
+                result.push_back(name);
+            }
+        }
+        return result;
     }
-}
+};
 
-void printUsage(char* programName) {
-    cout << "Использование: " << programName << " --file <filename> --query 'command'" << endl;
-    cout << "Пример: " << programName << " --file data.txt --query 'SETADD myset 10'" << endl;
-    cout << "Пример: " << programName << " --file data.txt --query 'SETUNION set1 set2 result'" << endl;
+// ---------- Индексированный формат ----------
+//
+// [StoreHeader A][StoreHeader B][области множеств, свободные области, индексы]
+// Индекс сопоставляет имени множества смещение и ёмкость его области и
+// число элементов, а также перечисляет свободные области. Чтение одного
+// множества — чтение индекса и одной области; изменение пишет только
+// новую область множества и новый индекс. Числа int32 хранятся в порядке
+// байтов машины.
+//
+// Файл никогда не переписывается на месте: новые данные и индекс ложатся в
+// свободные области, затем на диск уходит заголовок с номером поколения на
+// большим на единицу — в ту из двух копий, что не действует сейчас. Области,
+// освобождённые с последнего commit, до него не переиспользуются. При
+// открытии берётся копия с верными контрольными суммами и большим номером,
+// так что сбой посреди записи оставляет предыдущее состояние целым
+
+const char STORE_MAGIC[4] = {'M', 'S', 'T', 'I'};
+const uint32_t STORE_VERSION = 2;
+const uint64_t STORE_MIN_REGION = 64;        // Меньшие остатки не идут в свободный список
+
+struct StoreHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t generation;     // Номер commit; действует копия с большим номером
+    uint64_t indexOffset;    // Область индекса
+    uint64_t indexBytes;     // Длина индекса
+    uint64_t fileEnd;        // Конец занятой части файла
+    uint32_t indexChecksum;  // Контрольная сумма индекса
+    uint32_t checksum;       // Контрольная сумма предыдущих полей заголовка
+};
+static_assert(sizeof(StoreHeader) == 48, "Заголовок хранилища должен занимать 48 байт");
+
+const uint64_t STORE_DATA_START = 2 * sizeof(StoreHeader);
+
+// Участок файла
+struct Region {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// Запись индекса об одном множестве
+struct StoreEntry {
+    Region region;
+    uint32_t count;
+};
+
+// Файл начинается с сигнатуры индексированного формата
+bool isIndexedStore(const string& path) {
+    ifstream in(path, ios::binary);
+    char magic[4];
+    return in.read(magic, 4) && memcmp(magic, STORE_MAGIC, 4) == 0;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        printUsage(argv[0]);
-        return 1;
+class IndexedStore : public SetStore {
+private:
+    string path;
+    fstream file;
+    StoreHeader header;             // Действующая копия заголовка
+    map<string, StoreEntry> entries;
+    vector<Region> freeRegions;     // По возрастанию смещения, соседние слиты
+    vector<Region> pendingFree;     // Освобождены после commit, до следующего заняты
+    set<uint64_t> freshOffsets;     // Области, выделенные после commit
+    bool autoCommit = true;         // false — индекс пишется одним commit в конце
+    bool writable = true;           // false — файл открыт только на чтение
+
+    void writeAt(uint64_t offset, const void* data, size_t bytes) {
+        file.clear();
+        file.seekp((streamoff)offset);
+        file.write(static_cast<const char*>(data), bytes);
     }
-    
-    string filename;
-    string query;
-    
-    for (int i = 1; i < argc; i++) {
-        if (string(argv[i]) == "--file") {
-            if (++i < argc) {
-                filename = argv[i];
+
+    void readAt(uint64_t offset, void* data, size_t bytes) {
+        file.clear();
+        file.seekg((streamoff)offset);
+        file.read(static_cast<char*>(data), bytes);
+    }
+
+    // Первая подходящая свободная область или новая в конце файла
+    Region allocate(uint64_t bytes) {
+        Region taken = {header.fileEnd, bytes};
+        bool found = false;
+        for (size_t i = 0; i < freeRegions.size() && !found; i++) {
+            Region& r = freeRegions[i];
+            if (r.bytes < bytes) continue;
+            taken.offset = r.offset;
+            found = true;
+            if (r.bytes - bytes < STORE_MIN_REGION) {
+                taken.bytes = r.bytes;                  // Остаток отдаём целиком
+                freeRegions.erase(freeRegions.begin() + i);
             } else {
-                printUsage(argv[0]);
-                return 1;
+                r.offset += bytes;
+                r.bytes -= bytes;
             }
-        } else if (string(argv[i]) == "--query") {
-            if (++i < argc) {
-                query = argv[i];
-            } else {
-                printUsage(argv[0]);
-                return 1;
+        }
+        if (!found) header.fileEnd += bytes;
+        freshOffsets.insert(taken.offset);
+        return taken;
+    }
+
+    // Возврат области в список со слиянием соседей; свободный хвост файла
+    // просто отрезается
+    static void mergeRegion(vector<Region>& regions, Region region, uint64_t& fileEnd) {
+        if (region.bytes == 0) return;
+        auto it = lower_bound(regions.begin(), regions.end(), region.offset,
+                              [](const Region& r, uint64_t offset) { return r.offset < offset; });
+        it = regions.insert(it, region);
+        if (it + 1 != regions.end() && it->offset + it->bytes == (it + 1)->offset) {
+            it->bytes += (it + 1)->bytes;
+            regions.erase(it + 1);
+        }
+        if (it != regions.begin() && (it - 1)->offset + (it - 1)->bytes == it->offset) {
+            (it - 1)->bytes += it->bytes;
+            it = regions.erase(it) - 1;
+        }
+        if (it->offset + it->bytes == fileEnd) {
+            fileEnd = it->offset;
+            regions.erase(it);
+        }
+    }
+
+    // Область, записанная после commit, освобождается сразу; область из
+    // действующего индекса — только после следующего commit
+    void release(Region region) {
+        if (region.bytes == 0) return;
+        if (freshOffsets.erase(region.offset) != 0) {
+            mergeRegion(freeRegions, region, header.fileEnd);
+        } else {
+            pendingFree.push_back(region);
+        }
+    }
+
+    // Ёмкость области под n элементов с запасом на рост множества
+    static uint64_t capacityFor(size_t n) {
+        uint64_t bytes = n * sizeof(int32_t);
+        return std::max(STORE_MIN_REGION, bytes + bytes / 2);
+    }
+
+    static uint32_t headerChecksum(const StoreHeader& h) {
+        return checksum32(reinterpret_cast<const char*>(&h), offsetof(StoreHeader, checksum));
+    }
+
+    string serializeIndex(const vector<Region>& freeList) const {
+        string out;
+        auto put = [&out](const void* data, size_t bytes) { out.append(static_cast<const char*>(data), bytes); };
+        uint32_t counts[2] = {(uint32_t)entries.size(), (uint32_t)freeList.size()};
+        put(counts, sizeof(counts));
+        for (const auto& entry : entries) {
+            uint16_t nameBytes = (uint16_t)entry.first.size();
+            put(&nameBytes, sizeof(nameBytes));
+            put(entry.first.data(), nameBytes);
+            put(&entry.second, sizeof(StoreEntry));
+        }
+        for (const Region& r : freeList) put(&r, sizeof(Region));
+        return out;
+    }
+
+    bool parseIndex(const string& data) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        auto take = [&](void* out, size_t bytes) {
+            if ((size_t)(end - p) < bytes) return false;
+            memcpy(out, p, bytes);
+            p += bytes;
+            return true;
+        };
+        uint32_t counts[2];
+        if (!take(counts, sizeof(counts))) return false;
+        for (uint32_t i = 0; i < counts[0]; i++) {
+            uint16_t nameBytes;
+            StoreEntry entry;
+            if (!take(&nameBytes, sizeof(nameBytes)) || (size_t)(end - p) < nameBytes) return false;
+            string name(p, nameBytes);
+            p += nameBytes;
+            if (!take(&entry, sizeof(entry))) return false;
+            entries[name] = entry;
+        }
+        if ((size_t)(end - p) / sizeof(Region) < counts[1]) return false;
+        freeRegions.resize(counts[1]);
+        for (Region& r : freeRegions) {
+            if (!take(&r, sizeof(r))) return false;
+        }
+        return true;
+    }
+
+    // Копия заголовка годится, если цела она сама и индекс, на который она указывает
+    bool readHeaderSlot(int slot, uint64_t fileBytes, StoreHeader& h, string& index) {
+        readAt(slot * sizeof(StoreHeader), &h, sizeof(h));
+        if (!file || memcmp(h.magic, STORE_MAGIC, 4) != 0 || h.version != STORE_VERSION ||
+            h.checksum != headerChecksum(h) || h.indexOffset > h.fileEnd || h.indexBytes > h.fileEnd - h.indexOffset ||
+            h.indexOffset + h.indexBytes > fileBytes) {
+            return false;
+        }
+        index.assign(h.indexBytes, '\0');
+        readAt(h.indexOffset, &index[0], index.size());
+        return file && checksum32(index.data(), index.size()) == h.indexChecksum;
+    }
+
+    // Запись заголовка в неактивную копию; действует после fsync
+    bool writeHeader(StoreHeader h) {
+        h.checksum = headerChecksum(h);
+        writeAt((h.generation % 2) * sizeof(StoreHeader), &h, sizeof(h));
+        file.flush();
+        return file && syncFile(path);
+    }
+
+public:
+    // При false изменения не попадают в индекс до явного commit
+    void setAutoCommit(bool enabled) {
+        autoCommit = enabled;
+    }
+
+    // Запись нового индекса и заголовка. Сначала на диск уходят данные и
+    // индекс, затем заголовок; false, если записать не удалось (на диске
+    // тогда остаётся предыдущее состояние)
+    bool commit() {
+        // Прежний индекс не нужен после commit (при повторе после ошибки уже освобождён)
+        Region oldIndex = {header.indexOffset, header.indexBytes};
+        bool released = false;
+        for (const Region& r : pendingFree) released = released || r.offset == oldIndex.offset;
+        if (!released) release(oldIndex);
+
+        // Свободный список после commit: освобождённое с прошлого commit уже не нужно
+        uint64_t fileEnd = header.fileEnd;
+        vector<Region> freeAfter;
+        auto mergedFree = [&]() {
+            freeAfter = freeRegions;
+            fileEnd = header.fileEnd;
+            for (const Region& r : pendingFree) mergeRegion(freeAfter, r, fileEnd);
+        };
+        mergedFree();
+        Region r = allocate(serializeIndex(freeAfter).size() + sizeof(Region));
+        mergedFree();
+        string index = serializeIndex(freeAfter);
+        while (index.size() > r.bytes) {                // Выделение изменило свободный список
+            release(r);
+            r = allocate(index.size() + sizeof(Region));
+            mergedFree();
+            index = serializeIndex(freeAfter);
+        }
+        index.resize(r.bytes, '\0');                    // Индекс занимает область целиком
+        writeAt(r.offset, index.data(), index.size());
+        file.flush();
+        if (!file || !syncFile(path)) {
+            release(r);
+            return false;
+        }
+
+        StoreHeader next = header;
+        next.generation = header.generation + 1;
+        next.indexOffset = r.offset;
+        next.indexBytes = index.size();
+        next.indexChecksum = checksum32(index.data(), index.size());
+        next.fileEnd = fileEnd;
+        if (!writeHeader(next)) {
+            release(r);
+            return false;
+        }
+        header = next;
+        freeRegions = freeAfter;
+        pendingFree.clear();
+        freshOffsets.clear();
+        if (filesystem::file_size(path) > header.fileEnd) {
+            filesystem::resize_file(path, header.fileEnd);
+        }
+        return true;
+    }
+
+    // Открытие существующего хранилища или, при writable, создание пустого;
+    // false, если файла нет (только чтение) или это не индексированное хранилище.
+    // Без writable файл открывается только на чтение
+    bool open(const string& storePath, bool forWriting = true) {
+        path = storePath;
+        writable = forWriting;
+        entries.clear();
+        freeRegions.clear();
+        pendingFree.clear();
+        freshOffsets.clear();
+        if (!writable && !filesystem::exists(path)) {
+            return false;
+        }
+        if (writable && (!filesystem::exists(path) || filesystem::file_size(path) == 0)) {
+            ofstream create(path, ios::binary);
+            StoreHeader empty[2] = {};                  // Вторая копия пока недействительна
+            memcpy(empty[0].magic, STORE_MAGIC, 4);
+            empty[0].version = STORE_VERSION;
+            empty[0].generation = 0;
+            empty[0].indexOffset = STORE_DATA_START;
+            empty[0].fileEnd = STORE_DATA_START;
+            empty[0].indexChecksum = checksum32(nullptr, 0);
+            empty[0].checksum = headerChecksum(empty[0]);
+            create.write(reinterpret_cast<const char*>(empty), sizeof(empty));
+            create.close();
+            if (!create || !syncFile(path)) {
+                return false;
             }
         }
+        file.open(path, writable ? ios::in | ios::out | ios::binary : ios::in | ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        uint64_t fileBytes = filesystem::file_size(path);
+        StoreHeader slots[2];
+        string indexes[2];
+        bool valid[2];
+        for (int slot = 0; slot < 2; slot++) {
+            valid[slot] = readHeaderSlot(slot, fileBytes, slots[slot], indexes[slot]);
+        }
+        if (!valid[0] && !valid[1]) {
+            return false;
+        }
+        int active = valid[0] && valid[1] ? (slots[1].generation > slots[0].generation ? 1 : 0) : (valid[1] ? 1 : 0);
+        header = slots[active];
+        return indexes[active].empty() || parseIndex(indexes[active]);
     }
-    
-    if (query.empty()) {
-        cout << "Ошибка. Не указана команда." << endl;
-        return 1;
+
+    bool load(const string& name, vector<int>& elements) override {
+        elements.clear();
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            return false;
+        }
+        // Запись индекса за пределами файла — след чужой незавершённой записи
+        const StoreEntry& entry = it->second;
+        if ((uint64_t)entry.count * sizeof(int32_t) > entry.region.bytes ||
+            entry.region.offset + entry.region.bytes > header.fileEnd) {
+            return false;
+        }
+        elements.resize(entry.count);
+        readAt(it->second.region.offset, elements.data(), elements.size() * sizeof(int32_t));
+        return true;
     }
-    
-    // Определяем тип операции по первой букве
-    if (query.substr(0, 3) == "SET") {
-        setMenu(query, filename);
-    } else {
-        cout << "Ошибка. Неизвестный тип команды." << endl;
-        return 1;
+
+    // Множество пишется в новую область; на месте — только в область,
+    // выделенную после commit, пока оно в ней помещается и занимает не
+    // меньше её четверти
+    void save(const string& name, const vector<int>& elements) override {
+        uint64_t bytes = elements.size() * sizeof(int32_t);
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            it = entries.insert({name, StoreEntry{{0, 0}, 0}}).first;
+        }
+        StoreEntry& entry = it->second;
+        if (freshOffsets.count(entry.region.offset) == 0 || bytes > entry.region.bytes ||
+            capacityFor(elements.size()) * 2 < entry.region.bytes) {
+            release(entry.region);
+            entry.region = allocate(capacityFor(elements.size()));
+        }
+        entry.count = (uint32_t)elements.size();
+        writeAt(entry.region.offset, elements.data(), bytes);
+        if (autoCommit && !commit()) {
+            cout << "Ошибка записи хранилища " << path << endl;
+        }
     }
-    
-    return 0;
+
+    void remove(const string& name) override {
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            return;
+        }
+        release(it->second.region);
+        entries.erase(it);
+        if (autoCommit && !commit()) {
+            cout << "Ошибка записи хранилища " << path << endl;
+        }
+    }
+
+    // Набор изменений (снимок сервера) записывается одним commit
+    bool applyChanges(const map<string, const vector<int>*>& changes) override {
+        bool wasAuto = autoCommit;
+        autoCommit = false;
+        for (const auto& change : changes) {
+            if (change.second != nullptr) save(change.first, *change.second);
+            else remove(change.first);
+        }
+        autoCommit = wasAuto;
+        return commit();
+    }
+
+    vector<string> names() override {
+        vector<string> result;
+        for (const auto& entry : entries) result.push_back(entry.first);
+        return result;
+    }
+
+    // Индекс в памяти устаревает, если файл менял другой процесс
+    void refresh() override {
+        file.close();
+        open(path, writable);
+    }
+};
+
+// Перевод текстового файла множеств в индексированный формат через
+// временный файл, который затем заменяет исходный
+bool convertToIndexed(const string& filenm) {
+    string tmpPath = filenm + ".tmp";
+    remove(tmpPath.c_str());
+    {
+        TextStore text(filenm);
+        IndexedStore indexed;
+        if (!indexed.open(tmpPath)) {
+            return false;
+        }
+        indexed.setAutoCommit(false);
+        vector<int> elements;
+        for (const string& name : text.names()) {
+            text.load(name, elements);
+            indexed.save(name, elements);
+        }
+        if (!indexed.commit()) {
+            return false;
+        }
+    }
+    return replaceFile(filenm, tmpPath);
+}
+
+// ---------- Сегментированное хранилище ----------
+// Вместо файла — каталог, в нём по сегменту <имя>.seg на каждое множество:
+// элементы подряд как int32. Изменение множества переписывает только его
+// сегмент (через временный файл и переименование), поэтому размер других
+// множеств на запись не влияет, а записи в разные множества не мешают
+// друг другу. Символы имени, недопустимые в именах файлов, кодируются %XX
+
+const char* const SEGMENT_SUFFIX = ".seg";
+
+string encodeSegmentName(const string& name) {
+    static const char hex[] = "0123456789ABCDEF";
+    string result;
+    for (unsigned char c : name) {
+        if (isalnum(c) || c == '_' || c == '-') {
+            result += (char)c;
+        } else {
+            result += '%';
+            result += hex[c >> 4];
+            result += hex[c & 15];
+        }
+    }
+    return result + SEGMENT_SUFFIX;
+}
+
+// Имя множества по имени сегмента; false, если файл не сегмент
+bool decodeSegmentName(const string& fileName, string& name) {
+    size_t suffixBytes = strlen(SEGMENT_SUFFIX);
+    if (fileName.size() <= suffixBytes || fileName.compare(fileName.size() - suffixBytes, suffixBytes, SEGMENT_SUFFIX) != 0) {
+        return false;
+    }
+    name.clear();
+    for (size_t i = 0; i + suffixBytes < fileName.size(); i++) {
+        if (fileName[i] != '%') {
+            name += fileName[i];
+            continue;
+        }
+        if (i + 2 + suffixBytes >= fileName.size() || !isxdigit((unsigned char)fileName[i + 1]) ||
+            !isxdigit((unsigned char)fileName[i + 2])) {
+            return false;
+        }
+        name += (char)stoi(fileName.substr(i + 1, 2), nullptr, 16);
+        i += 2;
+    }
+    return true;
+}
+
+class SegmentedStore : public SetStore {
+private:
+    string directory;
+
+    string segmentPath(const string& name) const {
+        return (filesystem::path(directory) / encodeSegmentName(name)).string();
+    }
+
+    bool writeSegment(const string& name, const vector<int>& elements) {
+        string path = segmentPath(name);
+        string tmpPath = path + ".tmp";
+        ofstream out(tmpPath, ios::binary);
+        out.write(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(int32_t));
+        out.close();
+        if (!out || !replaceFile(path, tmpPath)) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool removeSegment(const string& name) {
+        error_code ec;
+        filesystem::remove(segmentPath(name), ec);
+        syncFile(directory);
+        return !ec;
+    }
+
+public:
+    explicit SegmentedStore(const string& path) : directory(path) {
+        error_code ec;
+        filesystem::create_directories(directory, ec);
+    }
+
+    bool load(const string& name, vector<int>& elements) override {
+        elements.clear();
+        string data;
+        if (!readWholeFile(segmentPath(name), data)) {
+            return false;
+        }
+        elements.resize(data.size() / sizeof(int32_t));
+        memcpy(elements.data(), data.data(), elements.size() * sizeof(int32_t));
+        return true;
+    }
+
+    void save(const string& name, const vector<int>& elements) override {
+        if (!writeSegment(name, elements)) {
+            cout << "Ошибка записи сегмента множества '" << name << "'" << endl;
+        }
+    }
+
+    void remove(const string& name) override {
+        removeSegment(name);
+    }
+
+    vector<string> names() override {
+        vector<string> result;
+        error_code ec;
+        string name;
+        for (const auto& entry : filesystem::directory_iterator(directory, ec)) {
+            if (decodeSegmentName(entry.path().filename().string(), name)) result.push_back(name);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    // Сегменты независимы, поэтому снимок пишет их в несколько потоков:
+    // время уходит в основном на fsync каждого сегмента
+    bool applyChanges(const map<string, const vector<int>*>& changes) override {
+        vector<pair<const string*, const vector<int>*>> work;
+        for (const auto& change : changes) work.push_back({&change.first, change.second});
+        size_t threads = std::min<size_t>(work.size(), std::max(1u, thread::hardware_concurrency()));
+        atomic<size_t> next(0);
+        atomic<bool> ok(true);
+        auto worker = [&]() {
+            for (size_t i; (i = next++) < work.size();) {
+                bool written = work[i].second != nullptr ? writeSegment(*work[i].first, *work[i].second)
+                                                         : removeSegment(*work[i].first);
+                if (!written) ok = false;
+            }
+        };
+        vector<thread> pool;
+        for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+        worker();
+        for (thread& t : pool) t.join();
+        return ok;
+    }
+};
+
+// Перевод текстового или индексированного файла в каталог сегментов.
+// Сегменты собираются во временном каталоге, который затем занимает место файла
+bool convertToSegmented(const string& filenm, SetStore& source) {
+    string tmpPath = filenm + ".tmp";
+    string oldPath = filenm + ".old";
+    error_code ec;
+    filesystem::remove_all(tmpPath, ec);
+    {
+        SegmentedStore segmented(tmpPath);
+        map<string, vector<int>> sets;
+        for (const string& name : source.names()) {
+            source.load(name, sets[name]);
+        }
+        map<string, const vector<int>*> changes;
+        for (const auto& entry : sets) changes[entry.first] = &entry.second;
+        if (!segmented.applyChanges(changes)) {
+            return false;
+        }
+    }
+    filesystem::rename(filenm, oldPath, ec);
+    if (ec) {
+        return false;
+    }
+    filesystem::rename(tmpPath, filenm, ec);
+    if (ec) {
+        filesystem::rename(oldPath, filenm, ec);
+        return false;
+    }
+    filesystem::remove(oldPath, ec);
+    string dir = filesystem::path(filenm).parent_path().string();
+    syncFile(dir.empty() ? "." : dir);
+    return true;
+}
+
+// Все множества в памяти поверх основного хранилища: читаются один раз,
+// а изменения копятся до flush и записываются в основное одним набором
+class MemoryStore : public SetStore {
+private:
+    SetStore& backing;
+    map<string, vector<int>> sets;
+    set<string> dirty;               // Изменённые и удалённые после flush
+
+public:
+    // Вызывается после каждого изменения: новое содержимое или nullptr при удалении
+    function<void(const string&, const vector<int>*)> onChange;
+
+    explicit MemoryStore(SetStore& store) : backing(store) {
+        for (const string& name : backing.names()) {
+            backing.load(name, sets[name]);
+        }
+    }
+
+    bool load(const string& name, vector<int>& elements) override {
+        auto it = sets.find(name);
+        if (it == sets.end()) {
+            elements.clear();
+            return false;
+        }
+        elements = it->second;
+        return true;
+    }
+
+    void save(const string& name, const vector<int>& elements) override {
+        vector<int>& stored = sets[name];
+        stored = elements;
+        dirty.insert(name);
+        if (onChange) onChange(name, &stored);
+    }
+
+    void remove(const string& name) override {
+        sets.erase(name);
+        dirty.insert(name);
+        if (onChange) onChange(name, nullptr);
+    }
+
+    vector<string> names() override {
+        vector<string> result;
+        for (const auto& entry : sets) result.push_back(entry.first);
+        return result;
+    }
+
+    size_t dirtyCount() const {
+        return dirty.size();
+    }
+
+    // Запись накопленных изменений; при ошибке они остаются несохранёнными
+    bool flush() {
+        if (dirty.empty()) {
+            return true;
+        }
+        map<string, const vector<int>*> changes;
+        for (const string& name : dirty) {
+            auto it = sets.find(name);
+            changes[name] = it != sets.end() ? &it->second : nullptr;
+        }
+        if (!backing.applyChanges(changes)) {
+            return false;
+        }
+        dirty.clear();
+        return true;
+    }
+};
+
+// ---------- Журнал изменений ----------
+// Сервер дописывает в <файл>.wal каждое изменение до ответа клиенту.
+// SETADD и SETDEL пишутся одной записью с элементом, поэтому размер записи
+// не зависит от размера множества; изменения нескольких множеств
+// (SETUNION и др.), создание и очистка пишутся новым содержимым
+// множества целиком или его удалением. Каждая запись задаёт итог для
+// своего элемента или множества независимо от прежнего состояния, поэтому
+// повтор записей поверх снимка, уже содержащего часть изменений, ничего не
+// портит. После каждого надёжно записанного снимка в журнал добавляется
+// отметка 'C': восстановление начинается с последней отметки. Формат записи:
+//   [u32 длина данных][u32 контрольная сумма FNV-1a][данные]
+//   данные: операция, u16 длина имени, имя, u32 число элементов, int32...
+//   'S' — содержимое множества, 'R' — удаление множества,
+//   'A' / 'D' — добавление / удаление одного элемента, 'C' — снимок записан
+// Оборванная или испорченная запись в конце журнала (сбой посреди записи)
+// отбрасывается вместе со всем, что за ней
+
+const char WAL_SET = 'S';
+const char WAL_REMOVE = 'R';
+const char WAL_ADD = 'A';
+const char WAL_DELETE = 'D';
+const char WAL_CHECKPOINT = 'C';
+
+// Одна запись журнала
+struct WalRecord {
+    char op;
+    string name;
+    vector<int> elements;    // Содержимое для 'S', один элемент для 'A' и 'D'
+};
+
+string walPath(const string& filenm) {
+    return filenm + ".wal";
+}
+
+void appendWalRecord(string& out, char op, const string& name, const int* elements, uint32_t count) {
+    uint16_t nameBytes = (uint16_t)name.size();
+    uint32_t payloadBytes = 1 + sizeof(nameBytes) + nameBytes + sizeof(count) + count * sizeof(int32_t);
+    size_t start = out.size();
+    out.resize(start + 2 * sizeof(uint32_t) + payloadBytes);
+    char* p = &out[start + 2 * sizeof(uint32_t)];
+    char* payload = p;
+    *p++ = op;
+    memcpy(p, &nameBytes, sizeof(nameBytes));
+    p += sizeof(nameBytes);
+    memcpy(p, name.data(), nameBytes);
+    p += nameBytes;
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+    if (count > 0) memcpy(p, elements, count * sizeof(int32_t));
+    uint32_t checksum = checksum32(payload, payloadBytes);
+    memcpy(&out[start], &payloadBytes, sizeof(payloadBytes));
+    memcpy(&out[start + sizeof(uint32_t)], &checksum, sizeof(checksum));
+}
+
+// Записи журнала после последней отметки снимка
+vector<WalRecord> readWal(const string& path) {
+    vector<WalRecord> records;
+    string data;
+    if (!readWholeFile(path, data)) {
+        return records;
+    }
+    const char* p = data.data();
+    const char* end = p + data.size();
+    while ((size_t)(end - p) >= 2 * sizeof(uint32_t)) {
+        uint32_t payloadBytes, checksum;
+        memcpy(&payloadBytes, p, sizeof(payloadBytes));
+        memcpy(&checksum, p + sizeof(uint32_t), sizeof(checksum));
+        const char* payload = p + 2 * sizeof(uint32_t);
+        if ((size_t)(end - payload) < payloadBytes || checksum32(payload, payloadBytes) != checksum) {
+            break;
+        }
+        uint16_t nameBytes;
+        uint32_t count;
+        const char* q = payload + 1;
+        if (payloadBytes < 1 + sizeof(nameBytes)) break;
+        memcpy(&nameBytes, q, sizeof(nameBytes));
+        q += sizeof(nameBytes);
+        if (payloadBytes < 1 + sizeof(nameBytes) + nameBytes + sizeof(count)) break;
+        WalRecord record;
+        record.op = payload[0];
+        record.name.assign(q, nameBytes);
+        q += nameBytes;
+        memcpy(&count, q, sizeof(count));
+        q += sizeof(count);
+        if (payloadBytes != (size_t)(q - payload) + (size_t)count * sizeof(int32_t)) {
+            break;
+        }
+        record.elements.resize(count);
+        if (count > 0) memcpy(record.elements.data(), q, count * sizeof(int32_t));
+        if (record.op == WAL_CHECKPOINT) {
+            records.clear();             // Всё до отметки уже есть в снимке
+        } else {
+            records.push_back(move(record));
+        }
+        p = payload + payloadBytes;
+    }
+    return records;
+}
+
+// Работающий сервер держит на своём журнале исключительный flock.
+// Возвращает дескриптор с этой блокировкой или -1, если журнал занят
+int lockIdleWal(const string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+// Журнал остался от аварийно остановленного сервера и его нужно применить
+bool walLeftOver(const string& filenm) {
+    string path = walPath(filenm);
+    if (!filesystem::exists(path)) {
+        return false;
+    }
+    int fd = lockIdleWal(path);
+#ifndef _WIN32
+    if (fd >= 0) close(fd);
+#endif
+    return fd >= 0;
+}
+
+// Применение журнала, оставшегося после аварийной остановки сервера.
+// Журнал удаляется только после того, как изменения надёжно записаны;
+// flock на нём держится от чтения до удаления. Журнал работающего сервера
+// не трогается. Вызывается под исключительной блокировкой хранилища, под
+// которой же сервер при запуске блокирует свой журнал, поэтому журнал
+// запускающегося сервера не может сойти за брошенный
+bool recoverFromWal(const string& filenm, SetStore& store, ostream& out) {
+    string path = walPath(filenm);
+    if (!filesystem::exists(path)) {
+        return true;
+    }
+    int fd = lockIdleWal(path);
+    if (fd < 0) {
+        return true;
+    }
+    map<string, optional<vector<int>>> sets;    // Итог по множеству; nullopt — удалено
+    for (const WalRecord& record : readWal(path)) {
+        auto it = sets.find(record.name);
+        if (it == sets.end()) {
+            vector<int> elements;
+            it = sets.emplace(record.name, store.load(record.name, elements) ? optional<vector<int>>(move(elements))
+                                                                               : nullopt).first;
+        }
+        optional<vector<int>>& current = it->second;
+        if (record.op == WAL_SET) {
+            current = record.elements;
+        } else if (record.op == WAL_REMOVE) {
+            current = nullopt;
+        } else if ((record.op == WAL_ADD || record.op == WAL_DELETE) && record.elements.size() == 1) {
+            if (!current) current.emplace();
+            auto found = find(current->begin(), current->end(), record.elements[0]);
+            if (record.op == WAL_ADD && found == current->end()) current->push_back(record.elements[0]);
+            if (record.op == WAL_DELETE && found != current->end()) current->erase(found);
+        }
+    }
+    map<string, const vector<int>*> changes;
+    for (const auto& entry : sets) {
+        changes[entry.first] = entry.second ? &*entry.second : nullptr;
+    }
+    bool applied = changes.empty() || store.applyChanges(changes);
+    if (applied) {
+        if (!changes.empty()) out << "Восстановлено из журнала множеств: " << changes.size() << endl;
+        remove(path.c_str());
+    }
+#ifndef _WIN32
+    close(fd);
+#endif
+    return applied;
+}
+
+// ---------- Совместная работа нескольких процессов ----------
+// Рядом с хранилищем лежит <файл>.lock. Изменяющие команды берут на нём
+// исключительный flock и выполняются строго по одной. В первых 8 байтах
+// файла — счётчик версий, отображённый в память всех процессов: писатель
+// делает его нечётным на время записи и снова чётным после. Читатель
+// блокировку не берёт: запоминает версию, выполняет запрос и сверяет
+// версию; если шла запись, результат отбрасывается и запрос повторяется,
+// а после нескольких неудач выполняется под общим flock. Поэтому читатели
+// не ждут друг друга и не мешают писателям.
+//
+// В сегментированном хранилище каждое множество — свой файл, который
+// заменяется целиком, поэтому изменения разных множеств не мешают друг
+// другу. Там писатель берёт на <файл>.lock общий flock (исключительный
+// нужен только переводу формата, восстановлению и снимку сервера), а на
+// <сегмент>.lock каждого своего множества — исключительный, на множества,
+// которые только читает, — общий. Блокировки множеств берутся в порядке
+// имён, чтобы писатели не ждали друг друга по кругу. Счётчик версий такие
+// писатели не трогают: чтение одного сегмента и так видит его целиком.
+// В Windows блокировки нет
+
+const int OPTIMISTIC_ATTEMPTS = 8;
+
+class StoreLock {
+private:
+    int fd = -1;
+    atomic<uint64_t>* version = nullptr;
+    static_assert(atomic<uint64_t>::is_always_lock_free, "Счётчик версий должен работать без блокировок");
+
+public:
+    ~StoreLock() {
+#ifndef _WIN32
+        if (version != nullptr) munmap(version, sizeof(uint64_t));
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    // Читатель (writable = false) только читает счётчик, поэтому файл
+    // блокировки открывается на чтение и не создаётся: если его нет,
+    // писателей ещё не было и читать можно без блокировки
+    bool open(const string& storePath, bool writable) {
+#ifndef _WIN32
+        string lockPath = storePath + ".lock";
+        if (!writable) {
+            fd = ::open(lockPath.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(uint64_t)) {
+                return true;
+            }
+            void* mapped = mmap(nullptr, sizeof(uint64_t), PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) version = static_cast<atomic<uint64_t>*>(mapped);
+            return true;
+        }
+        fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            return false;
+        }
+        if (st.st_size < (off_t)sizeof(uint64_t) && ftruncate(fd, sizeof(uint64_t)) != 0) {
+            return false;
+        }
+        void* mapped = mmap(nullptr, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        version = static_cast<atomic<uint64_t>*>(mapped);
+#else
+        (void)storePath;
+        (void)writable;
+#endif
+        return true;
+    }
+
+    void lockShared() {
+#ifndef _WIN32
+        while (flock(fd, LOCK_SH) != 0 && errno == EINTR) {}
+#endif
+    }
+
+    void lockExclusive() {
+#ifndef _WIN32
+        while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+#endif
+    }
+
+    void unlock() {
+#ifndef _WIN32
+        flock(fd, LOCK_UN);
+#endif
+    }
+
+    // Только под исключительной блокировкой. Нечётная версия в начале
+    // записи остаётся от писателя, завершившегося посреди записи
+    void beginWrite() {
+        if (version == nullptr) return;
+        uint64_t current = version->load();
+        version->store(current % 2 == 0 ? current + 1 : current + 2);
+    }
+
+    void endWrite() {
+        if (version != nullptr) version->fetch_add(1);
+    }
+
+    uint64_t readBegin() const {
+        return version != nullptr ? version->load() : 0;
+    }
+
+    // Чтение, начатое на версии started, не пересекалось ни с одной записью
+    bool readValid(uint64_t started) const {
+        return started % 2 == 0 && (version == nullptr || version->load() == started);
+    }
+};
+
+// Блокировки отдельных множеств сегментированного хранилища
+class SetLocks {
+private:
+    vector<int> fds;
+
+public:
+    SetLocks() {}
+    SetLocks(const SetLocks&) = delete;
+    SetLocks& operator=(const SetLocks&) = delete;
+
+    ~SetLocks() {
+#ifndef _WIN32
+        for (int fd : fds) close(fd);    // Закрытие снимает flock
+#endif
+    }
+
+    // Множество -> нужна ли исключительная блокировка; false, если файл
+    // блокировки какого-то множества не открылся
+    bool acquire(const string& directory, const map<string, bool>& sets) {
+#ifndef _WIN32
+        for (const auto& entry : sets) {
+            string lockPath = (filesystem::path(directory) / encodeSegmentName(entry.first)).string() + ".lock";
+            int fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0) {
+                return false;
+            }
+            fds.push_back(fd);
+            while (flock(fd, entry.second ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR) {}
+        }
+#else
+        (void)directory;
+        (void)sets;
+#endif
+        return true;
+    }
+};
+
+// ---------- Команды ----------
+
+// Пределы форматов хранения: длина имени пишется в индекс и журнал как u16,
+// число элементов — как u32
+const size_t MAX_SET_NAME_BYTES = numeric_limits<uint16_t>::max();
+const size_t MAX_SET_ELEMENTS = numeric_limits<uint32_t>::max();
+
+// Чтение множества из хранилища. Повторы (возможные в текстовом файле)
+// отсеиваются хеш-множеством, а не поиском по списку на каждую вставку
+Set loadSet(SetStore& store, const string& name) {
+    Set mySet;
+    vector<int> elements;
+    store.load(name, elements);
+    unordered_set<int> seen(elements.size() * 2);
+    for (int value : elements) {
+        if (seen.insert(value).second) {
+            mySet.insertNew(value);
+        }
+    }
+    return mySet;
+}
+
+// Запись множества в хранилище; false, если множество слишком велико
+bool saveSet(SetStore& store, const string& name, const Set& mySet, ostream& out) {
+    vector<int> elements;
+    mySet.getElements(elements);
+    if (elements.size() > MAX_SET_ELEMENTS) {
+        out << "Ошибка: в множестве '" << name << "' больше " << MAX_SET_ELEMENTS << " элементов" << endl;
+        return false;
+    }
+    store.save(name, elements);
+    return true;
+}
+
+// Функция добавления элементов в множество
+void SETADD(SetStore& store, string& name, string& value, ostream& out) {
+    Set mySet = loadSet(store, name);
+    
+    int num;
+    if (!parseInt(value, num)) {
+        out << "Ошибка: некорректное значение" << endl;
+        return;
+    }
+    if (mySet.insert(num)) {
+        if (!saveSet(store, name, mySet, out)) return;
+        out << "Элемент " << num << " добавлен в множество '" << name << "'" << endl;
+    } else {
+        out << "Элемент " << num << " уже существует в множестве" << endl;
+    }
+}
+
+// Функция удаления элементов из множества
+void SETDEL(SetStore& store, string& name, string& value, ostream& out) {
+    Set mySet = loadSet(store, name);
+    
+    int num;
+    if (!parseInt(value, num)) {
+        out << "Ошибка: некорректное значение" << endl;
+        return;
+    }
+    if (mySet.erase(num)) {
+        if (!saveSet(store, name, mySet, out)) return;
+        out << "Элемент " << num << " удален из множества '" << name << "'" << endl;
+    } else {
+        out << "Элемент " << num << " не найден в множестве" << endl;
+    }
+}
+
+// Функция проверки наличия элемента в множестве
+void SET_AT(SetStore& store, string& name, string& value, ostream& out) {
+    Set mySet = loadSet(store, name);
+    
+    int num;
+    if (!parseInt(value, num)) {
+        out << "Ошибка: некорректное значение" << endl;
+        return;
+    }
+    if (mySet.contains(num)) {
+        out << "True" << endl;
+    } else {
+        out << "False" << endl;
+    }
+}
+
+// Функция вывода размера множества
+void SET_SIZE(SetStore& store, string& name, ostream& out) {
+    Set mySet = loadSet(store, name);
+    out << mySet.size() << endl;
+}
+
+// Функция вывода всех элементов множества
+void SET_PRINT(SetStore& store, string& name, ostream& out) {
+    Set mySet = loadSet(store, name);
+    mySet.print(out);
+}
+
+// Функция очистки множества
+void SET_CLEAR(SetStore& store, string& name, ostream& out) {
+    store.remove(name);
+    out << "Множество '" << name << "' очищено" << endl;
+}
+
+// Функция вывода суммы элементов множества
+void SET_SUM(SetStore& store, string& name, ostream& out) {
+    Set mySet = loadSet(store, name);
+    out << mySet.sum() << endl;
+}
+
+// Функция создания пустого множества
+void SET_CREATE(SetStore& store, string& name, ostream& out) {
+    store.save(name, vector<int>());
+    out << "Множество '" << name << "' создано" << endl;
+}
+
+// Функция объединения двух множеств
+void SET_UNION(SetStore& store, string& name1, string& name2, string& resultName, ostream& out) {
+    Set set1 = loadSet(store, name1);
+    Set set2 = loadSet(store, name2);
+    
+    // Создаем объединение
+    Set resultSet;
+    
+    // Добавляем элементы из первого множества
+    vector<int> elements1;
+    set1.getElements(elements1);
+    for (int elem : elements1) {
+        resultSet.insert(elem);
+    }
+    
+    // Добавляем элементы из второго множества
+    vector<int> elements2;
+    set2.getElements(elements2);
+    for (int elem : elements2) {
+        resultSet.insert(elem);
+    }
+    
+    if (!saveSet(store, resultName, resultSet, out)) return;
+    out << "Объединение множеств '" << name1 << "' и '" << name2 
+         << "' сохранено в '" << resultName << "'" << endl;
+}
+
+// Функция пересечения двух множеств
+void SET_INTERSECT(SetStore& store, string& name1, string& name2, string& resultName, ostream& out) {
+    Set set1 = loadSet(store, name1);
+    Set set2 = loadSet(store, name2);
+    
+    // Создаем пересечение
+    Set resultSet;
+    
+    // Находим общие элементы
+    vector<int> elements1;
+    set1.getElements(elements1);
+    for (int elem : elements1) {
+        if (set2.contains(elem)) {
+            resultSet.insert(elem);
+        }
+    }
+    
+    if (!saveSet(store, resultName, resultSet, out)) return;
+    out << "Пересечение множеств '" << name1 << "' и '" << name2 
+         << "' сохранено в '" << resultName << "'" << endl;
+}
+
+// Функция разности двух множеств
+void SET_DIFFERENCE(SetStore& store, string& name1, string& name2, string& resultName, ostream& out) {
+    Set set1 = loadSet(store, name1);
+    Set set2 = loadSet(store, name2);
+    
+    // Создаем разность
+    Set resultSet;
+    
+    // Находим элементы, которые есть в первом, но нет во втором
+    vector<int> elements1;
+    set1.getElements(elements1);
+    for (int elem : elements1) {
+        if (!set2.contains(elem)) {
+            resultSet.insert(elem);
+        }
+    }
+    
+    if (!saveSet(store, resultName, resultSet, out)) return;
+    out << "Разность множеств '" << name1 << "' и '" << name2 
+         << "' сохранена в '" << resultName << "'" << endl;
+}
+
+// Обработка команд для множеств: первое слово — команда, затем операнды
+void setMenu(const string& command, SetStore& store, ostream& out) {
+    string op, name, name2, resultName, value;
+    stringstream stream(command);
+    stream >> op;
+    
+    // Имя длиннее предела нельзя записать ни в индекс, ни в журнал
+    string word;
+    while (stream >> word) {
+        if (word.size() > MAX_SET_NAME_BYTES) {
+            out << "Ошибка: имя множества длиннее " << MAX_SET_NAME_BYTES << " байт" << endl;
+            return;
+        }
+    }
+    stream.clear();
+    stream.seekg(0);
+    stream >> op;
+    
+    if (op == "SETADD") {
+        stream >> name >> value;
+        SETADD(store, name, value, out);
+    } 
+    else if (op == "SETDEL") {
+        stream >> name >> value;
+        SETDEL(store, name, value, out);
+    } 
+    else if (op == "SET_AT") {
+        stream >> name >> value;
+        SET_AT(store, name, value, out);
+    } 
+    else if (op == "SETSIZE") {
+        stream >> name;
+        SET_SIZE(store, name, out);
+    } 
+    else if (op == "SETPRINT") {
+        stream >> name;
+        SET_PRINT(store, name, out);
+    } 
+    else if (op == "SETCLEAR") {
+        stream >> name;
+        SET_CLEAR(store, name, out);
+    } 
+    else if (op == "SETSUM") {
+        stream >> name;
+        SET_SUM(store, name, out);
+    } 
+    else if (op == "SETCREATE") {
+        stream >> name;
+        SET_CREATE(store, name, out);
+    } 
+    else if (op == "SETUNION") {
+        stream >> name >> name2 >> resultName;
+        SET_UNION(store, name, name2, resultName, out);
+    } 
+    else if (op == "SETINTERSECT") {
+        stream >> name >> name2 >> resultName;
+        SET_INTERSECT(store, name, name2, resultName, out);
+    } 
+    else if (op == "SETDIFFERENCE") {
+        stream >> name >> name2 >> resultName;
+        SET_DIFFERENCE(store, name, name2, resultName, out);
+    } 
+    else {
+        out << "Ошибка. Неизвестная команда для множества: " << command << endl;
+        out << "Доступные команды: SETADD, SETDEL, SET_AT, SETSIZE, SETPRINT, SETCLEAR, SETSUM, SETCREATE, SETUNION, SETINTERSECT, SETDIFFERENCE" << endl;
+    }
+}
+
+// Выполнение одной строки запроса
+void executeQuery(const string& query, SetStore& store, ostream& out) {
+    if (query.substr(0, 3) == "SET") {
+        setMenu(query, store, out);
+    } else {
+        out << "Ошибка. Неизвестный тип команды." << endl;
+    }
+}
+
+// Команды, которые только читают хранилище
+bool isReadOnlyQuery(const string& query) {
+    string op;
+    stringstream stream(query);
+    stream >> op;
+    return op == "SET_AT" || op == "SETSIZE" || op == "SETPRINT" || op == "SETSUM";
+}
+
+// Множества, которые затрагивает команда: имя -> изменяется ли оно
+map<string, bool> querySets(const string& query) {
+    string op, name, name2, resultName;
+    stringstream stream(query);
+    stream >> op >> name;
+    map<string, bool> sets;
+    if (op == "SETUNION" || op == "SETINTERSECT" || op == "SETDIFFERENCE") {
+        stream >> name2 >> resultName;
+        sets[resultName] = true;
+        sets.insert({name2, false});
+    }
+    sets.insert({name, false}).first->second |= !isReadOnlyQuery(query);
+    return sets;
+}
+
+// ---------- Режим сервера ----------
+//
+// Сервер держит все множества в MemoryStore и принимает те же команды по
+// Unix-сокету, по одной в строке. Клиент может отправить сразу много строк,
+// не дожидаясь ответов: ответы приходят в том же порядке, каждый
+// заканчивается пустой строкой. Каждое изменение сначала попадает в журнал;
+// ответ уходит клиенту только после fsync журнала, который выполняется
+// группой: набралось groupSize записей или прошло groupWindow с первой.
+// Снимок в основной файл — раз в snapshotSeconds секунд и при остановке
+// (SIGINT, SIGTERM), после снимка в журнал пишется отметка
+
+#ifndef _WIN32
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+struct Client {
+    int fd;
+    string input;            // Принятые байты без последней неполной строки
+    string output;           // Ответы, ещё не отправленные клиенту
+    string held;             // Ответы, ждущие записи журнала на диск
+    bool closing = false;    // Клиент закрыл запись: досылаем ответы и закрываем
+};
+
+// Журнал длиннее этого очищается при отметке снимка
+const off_t WAL_TRUNCATE_BYTES = 16 << 20;
+
+// Групповая запись журнала: изменения копятся в памяти и уходят на диск
+// одной записью с одним fsync на группу
+class WriteAheadLog {
+private:
+    int fd = -1;
+    string pendingBytes;
+    size_t pendingRecords = 0;
+    chrono::steady_clock::time_point oldestRecord;
+    char commandOp = 0;          // WAL_ADD / WAL_DELETE для выполняемой SETADD / SETDEL
+    string commandName;
+    int commandValue = 0;
+
+public:
+    ~WriteAheadLog() {
+        if (fd >= 0) close(fd);
+    }
+
+    // false, если журнал уже ведёт другой сервер
+    bool open(const string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        return fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0;
+    }
+
+    // Команда, изменения от которой придут в append: SETADD и SETDEL
+    // пишутся в журнал одним элементом, а не всем множеством
+    void beginCommand(const string& query) {
+        string op, value;
+        stringstream stream(query);
+        stream >> op >> commandName >> value;
+        commandOp = 0;
+        if ((op == "SETADD" || op == "SETDEL") && parseInt(value, commandValue)) {
+            commandOp = op == "SETADD" ? WAL_ADD : WAL_DELETE;
+        }
+    }
+
+    void append(const string& name, const vector<int>* elements) {
+        if (pendingRecords == 0) oldestRecord = chrono::steady_clock::now();
+        if (commandOp != 0 && elements != nullptr && name == commandName) {
+            appendWalRecord(pendingBytes, commandOp, name, &commandValue, 1);
+        } else if (elements != nullptr) {
+            appendWalRecord(pendingBytes, WAL_SET, name, elements->data(), (uint32_t)elements->size());
+        } else {
+            appendWalRecord(pendingBytes, WAL_REMOVE, name, nullptr, 0);
+        }
+        pendingRecords++;
+    }
+
+    size_t pending() const {
+        return pendingRecords;
+    }
+
+    chrono::steady_clock::time_point oldest() const {
+        return oldestRecord;
+    }
+
+    // Запись накопленной группы на диск; false, если записать не удалось
+    bool commit() {
+        size_t written = 0;
+        while (written < pendingBytes.size()) {
+            ssize_t n = write(fd, pendingBytes.data() + written, pendingBytes.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            written += n;
+        }
+        if (fdatasync(fd) != 0) {
+            return false;
+        }
+        pendingBytes.clear();
+        pendingRecords = 0;
+        return true;
+    }
+
+    // Снимок надёжно записан: изменения до этого места в журнале больше не
+    // нужны. Ещё не записанные изменения уже есть в снимке, вместо них
+    // пишется отметка; разросшийся журнал очищается
+    bool checkpoint() {
+        pendingBytes.clear();
+        pendingRecords = 0;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > WAL_TRUNCATE_BYTES) {
+            return ftruncate(fd, 0) == 0 && fsync(fd) == 0;
+        }
+        appendWalRecord(pendingBytes, WAL_CHECKPOINT, "", nullptr, 0);
+        return commit();
+    }
+};
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Адрес Unix-сокета; false, если путь слишком длинный
+bool socketAddress(const string& socketPath, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+
+// Чтение всего доступного и выполнение полных строк
+void serveInput(Client& client, SetStore& store, WriteAheadLog& wal) {
+    char buffer[65536];
+    while (true) {
+        ssize_t n = read(client.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            client.input.append(buffer, n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            client.closing = true;
+        }
+        if (n == 0 || errno != EINTR) break;
+    }
+
+    size_t start = 0, lineEnd;
+    ostringstream reply;
+    while ((lineEnd = client.input.find('\n', start)) != string::npos) {
+        string query = client.input.substr(start, lineEnd - start);
+        if (!query.empty() && query.back() == '\r') query.pop_back();
+        start = lineEnd + 1;
+        if (query.empty()) continue;
+        wal.beginCommand(query);
+        executeQuery(query, store, reply);
+        reply << "\n";
+    }
+    client.input.erase(0, start);
+    client.held += reply.str();
+}
+
+// Отправка накопленных ответов, сколько примет сокет; false при ошибке
+bool serveOutput(Client& client) {
+    size_t sent = 0;
+    while (sent < client.output.size()) {
+        ssize_t n = write(client.fd, client.output.data() + sent, client.output.size() - sent);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+    }
+    client.output.erase(0, sent);
+    return true;
+}
+
+// Каждый клиент ждёт придержанного ответа: новых изменений в группу до
+// записи журнала уже не придёт, ждать окончания окна незачем
+bool allWaiting(const vector<Client>& clients) {
+    for (const Client& client : clients) {
+        if (client.held.empty() && !client.closing) return false;
+    }
+    return true;
+}
+
+struct ServerOptions {
+    int snapshotSeconds = 5;
+    size_t groupSize = 64;                  // Записей журнала на один fsync
+    chrono::milliseconds groupWindow{2};    // Наибольшая задержка ответа ради группы
+};
+
+// Пока сервер работает, множества для него — те, что он прочитал при
+// запуске: изменения других процессов в обход сервера он не видит. Снимок
+// пишется под исключительной блокировкой хранилища и переписывает только
+// множества, изменённые через сервер. Журнал wal уже открыт и заблокирован
+// вызывающим — под той же блокировкой хранилища, что и восстановление
+int runServer(const string& socketPath, const string& filenm, SetStore& backing, const ServerOptions& options,
+              StoreLock& lock, WriteAheadLog& wal) {
+    sockaddr_un addr;
+    if (!socketAddress(socketPath, addr)) {
+        cout << "Ошибка. Слишком длинный путь сокета." << endl;
+        return 1;
+    }
+    lock.lockShared();
+    backing.refresh();
+    MemoryStore memory(backing);
+    lock.unlock();
+    auto snapshot = [&]() {
+        lock.lockExclusive();
+        lock.beginWrite();
+        backing.refresh();
+        bool saved = memory.flush();
+        lock.endWrite();
+        lock.unlock();
+        return saved;
+    };
+    memory.onChange = [&wal](const string& name, const vector<int>* elements) { wal.append(name, elements); };
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 128) < 0) {
+        cout << "Ошибка. Не удалось открыть сокет " << socketPath << endl;
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+    setNonBlocking(listener);
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    signal(SIGPIPE, SIG_IGN);
+    cout << "Сервер слушает " << socketPath << ", множеств: " << memory.names().size() << endl;
+
+    vector<Client> clients;
+    auto period = chrono::seconds(options.snapshotSeconds);
+    auto nextSnapshot = chrono::steady_clock::now() + period;
+    bool walFailed = false;
+    while (!stopRequested && !walFailed) {
+        vector<pollfd> fds;
+        fds.push_back({listener, POLLIN, 0});
+        for (const Client& client : clients) {
+            short events = (client.closing ? 0 : POLLIN) | (client.output.empty() ? 0 : POLLOUT);
+            fds.push_back({client.fd, events, 0});
+        }
+        auto deadline = nextSnapshot;
+        if (wal.pending() > 0) deadline = std::min(deadline, wal.oldest() + options.groupWindow);
+        auto wait = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        if (poll(fds.data(), fds.size(), std::max<long long>(0, wait.count())) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listener, nullptr, nullptr)) >= 0) {
+                setNonBlocking(fd);
+                clients.push_back(Client{fd, "", "", ""});
+            }
+        }
+        for (size_t i = 0; i + 1 < fds.size(); i++) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                serveInput(clients[i], memory, wal);
+            }
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (now >= nextSnapshot) {
+            // Снимок надёжно записан — журнал до него больше не нужен
+            if (snapshot() && !wal.checkpoint()) walFailed = true;
+            nextSnapshot = chrono::steady_clock::now() + period;
+        } else if (wal.pending() >= options.groupSize ||
+                   (wal.pending() > 0 && (now >= wal.oldest() + options.groupWindow || allWaiting(clients)))) {
+            if (!wal.commit()) walFailed = true;
+        }
+        if (walFailed) {
+            cerr << "Ошибка записи журнала, сервер останавливается" << endl;
+            break;
+        }
+
+        // Пока группа не записана, ответы на изменения придерживаются
+        for (Client& client : clients) {
+            if (wal.pending() == 0 && !client.held.empty()) {
+                client.output += client.held;
+                client.held.clear();
+            }
+            if (!serveOutput(client) || (client.closing && client.output.empty() && client.held.empty())) {
+                close(client.fd);
+                client.fd = -1;
+            }
+        }
+        clients.erase(remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd < 0; }),
+                      clients.end());
+    }
+
+    for (const Client& client : clients) close(client.fd);
+    close(listener);
+    unlink(socketPath.c_str());
+    size_t saved = memory.dirtyCount();
+    if (!wal.commit() || !snapshot()) {
+        cout << "Ошибка. Снимок не записан, изменения остаются в журнале " << walPath(filenm) << endl;
+        return 1;
+    }
+    remove(walPath(filenm).c_str());
+    cout << "Сервер остановлен, сохранено множеств: " << saved << endl;
+    return 0;
+}
+
+// Клиент: отправляет запрос (или все строки stdin подряд) и печатает ответы
+int runClient(const string& socketPath, const string& query) {
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!socketAddress(socketPath, addr) || fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        cout << "Ошибка. Нет соединения с сервером " << socketPath << endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    string request;
+    if (!query.empty()) {
+        request = query + "\n";
+    } else {
+        string line;
+        while (getline(cin, line)) request += line + "\n";
+    }
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t n = write(fd, request.data() + sent, request.size() - sent);
+        if (n <= 0) break;
+        sent += n;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // Пустые строки — разделители ответов, их не печатаем
+    string pending;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        pending.append(buffer, n);
+        size_t start = 0, lineEnd;
+        while ((lineEnd = pending.find('\n', start)) != string::npos) {
+            if (lineEnd > start) cout << pending.substr(start, lineEnd - start) << "\n";
+            start = lineEnd + 1;
+        }
+        pending.erase(0, start);
+    }
+    close(fd);
+    return 0;
+}
+#endif
+
+// Открытие хранилища: определение формата, перевод в формат --store и
+// применение оставшегося журнала. Перевод и журнал меняют файл, поэтому
+// выполняются только при writable (под исключительной блокировкой).
+// nullptr при ошибке, сообщение уже выведено в out
+SetStore* openStore(const string& filename, const string& storeKind, bool writable, ostream& out) {
+    // Запрос на чтение не создаёт хранилище: опечатка в пути — ошибка, а не пустой файл
+    if (!writable && !filesystem::exists(filename)) {
+        out << "Ошибка. Файл хранилища не найден: " << filename << endl;
+        return nullptr;
+    }
+    // Без --store формат определяется по содержимому файла; каталог — сегменты
+    bool segmented = filesystem::is_directory(filename);
+    bool indexed = !segmented && isIndexedStore(filename);
+    if (segmented && storeKind != "" && storeKind != "segmented") {
+        out << "Ошибка. Хранилище записано в сегментированном формате." << endl;
+        return nullptr;
+    }
+    if (storeKind == "text" && indexed) {
+        out << "Ошибка. Файл записан в индексированном формате." << endl;
+        return nullptr;
+    }
+    bool nonEmptyFile = !segmented && filesystem::exists(filename) && filesystem::file_size(filename) > 0;
+    if (storeKind == "indexed" && !indexed && nonEmptyFile) {
+        if (!convertToIndexed(filename)) {
+            out << "Ошибка. Не удалось преобразовать файл." << endl;
+            return nullptr;
+        }
+        out << "Файл преобразован в индексированный формат" << endl;
+    }
+    
+    SetStore* store;
+    if (segmented) {
+        store = new SegmentedStore(filename);
+    } else if (indexed || storeKind == "indexed") {
+        IndexedStore* indexedStore = new IndexedStore();
+        if (!indexedStore->open(filename, writable)) {
+            out << "Ошибка. Файл хранилища повреждён." << endl;
+            delete indexedStore;
+            return nullptr;
+        }
+        store = indexedStore;
+    } else {
+        store = new TextStore(filename);
+    }
+    if (storeKind == "segmented" && !segmented) {
+        bool converted = !nonEmptyFile || convertToSegmented(filename, *store);
+        delete store;
+        if (!converted) {
+            out << "Ошибка. Не удалось преобразовать файл." << endl;
+            return nullptr;
+        }
+        if (nonEmptyFile) {
+            out << "Файл преобразован в сегментированный формат" << endl;
+        } else {
+            error_code ec;
+            filesystem::remove(filename, ec);
+        }
+        store = new SegmentedStore(filename);
+    }
+    
+    // Изменения, которые сервер успел записать только в журнал
+    if (writable && !recoverFromWal(filename, *store, out)) {
+        out << "Ошибка. Не удалось применить журнал " << walPath(filename) << endl;
+        delete store;
+        return nullptr;
+    }
+    return store;
+}
+
+// --store требует перевести существующее хранилище в другой формат
+bool needsConversion(const string& filename, const string& storeKind) {
+    if (!filesystem::exists(filename)) {
+        return false;
+    }
+    bool segmented = filesystem::is_directory(filename);
+    bool indexed = !segmented && isIndexedStore(filename);
+    return (storeKind == "indexed" && !indexed && !segmented) || (storeKind == "segmented" && !segmented);
+}
+
+// Одиночный запрос; false, если хранилище не открылось
+bool runQuery(const string& filename, const string& storeKind, const string& query, bool writable, ostream& out) {
+    SetStore* store = openStore(filename, storeKind, writable, out);
+    if (store == nullptr) {
+        return false;
+    }
+    setMenu(query, *store, out);
+    delete store;
+    return true;
+}
+
+// ---------- Замер производительности ----------
+
+// Накопитель результатов, чтобы компилятор не выбросил замеряемые циклы
+static size_t benchSink = 0;
+
+// Секунды, прошедшие с момента start
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Скорость разбора текстового файла множеств: построчный getline и
+// stringstream против блочного чтения с parseIntTokens, а также поиск
+// одного множества через TextStore::load
+void runBenchmark() {
+    const size_t sets = 1000, perSet = 10000;
+    string path = (filesystem::temp_directory_path() / "partition_bench.txt").string();
+    {
+        mt19937 rng(12345);
+        ofstream out(path);
+        for (size_t i = 0; i < sets; i++) {
+            out << "set" << i;
+            for (size_t k = 0; k < perSet; k++) out << ' ' << (int)rng();
+            out << '\n';
+        }
+    }
+    double gigabytes = (double)filesystem::file_size(path) / 1e9;
+    cout << "Разбор текстового файла: " << sets << " множеств по " << perSet << " чисел ("
+         << gigabytes * 1000 << " МБ)" << endl;
+    cout << "способ                       время, с    ГБ/с" << endl;
+
+    auto start = chrono::steady_clock::now();
+    vector<int> values;
+    {
+        ifstream in(path);
+        string line, name;
+        while (getline(in, line)) {
+            stringstream ss(line);
+            ss >> name;
+            int num;
+            while (ss >> num) values.push_back(num);
+        }
+    }
+    double seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "getline и stringstream >>", seconds, gigabytes / seconds);
+    benchSink += values.size();
+
+    values.clear();
+    ParseReport report;
+    start = chrono::steady_clock::now();
+    forEachLine(path, [&](const char* line, const char* lineEnd) {
+        const char* nameEnd = static_cast<const char*>(memchr(line, ' ', lineEnd - line));
+        parseIntTokens(nameEnd != nullptr ? nameEnd : lineEnd, lineEnd, true, 0, values, report);
+    });
+    seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "блоки, один проход", seconds, gigabytes / seconds);
+    benchSink += values.size() + report.malformed;
+
+    TextStore store(path);
+    start = chrono::steady_clock::now();
+    store.load("set" + to_string(sets - 1), values);
+    seconds = secondsSince(start);
+    printf("%-28s %8.4f %7.3f\n", "TextStore::load, одно", seconds, gigabytes / seconds);
+    benchSink += values.size();
+
+    remove(path.c_str());
+}
+
+void printUsage(char* programName) {
+    cout << "Использование: " << programName << " --file <filename> --query 'command' [--store text|indexed|segmented]" << endl;
+    cout << "Пример: " << programName << " --file data.txt --query 'SETADD myset 10'" << endl;
+    cout << "Пример: " << programName << " --file data.txt --query 'SETUNION set1 set2 result'" << endl;
+    cout << "--store indexed переводит текстовый файл в индексированный формат" << endl;
+    cout << "--store segmented переводит файл в каталог с отдельным файлом на каждое множество" << endl;
+    cout << "С одним файлом могут одновременно работать несколько процессов: изменения выполняются по очереди"
+         << " (в сегментированном хранилище — по очереди только для одного множества),"
+         << " а SET_AT, SETSIZE, SETPRINT и SETSUM читают без блокировок" << endl;
+    cout << "Сервер: " << programName << " --file data.txt --serve <сокет> [--snapshot-every секунд]"
+         << " [--group-size записей] [--group-window-ms мс]" << endl;
+    cout << "Клиент: " << programName << " --connect <сокет> [--query 'command'] (без --query — команды из stdin)" << endl;
+    cout << "Замер производительности: " << programName << " --bench" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string filename;
+    string query;
+    string storeKind;
+    string servePath;
+    string connectPath;
+#ifndef _WIN32
+    ServerOptions serverOptions;
+#endif
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            runBenchmark();
+            return 0;
+        } else if ((arg == "--file" || arg == "--query" || arg == "--store" || arg == "--serve" || arg == "--connect") && i + 1 < argc) {
+            string& target = arg == "--file" ? filename : arg == "--query" ? query : arg == "--store" ? storeKind
+                           : arg == "--serve" ? servePath : connectPath;
+            target = argv[++i];
+#ifndef _WIN32
+        } else if (arg == "--snapshot-every" && i + 1 < argc) {
+            serverOptions.snapshotSeconds = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--group-size" && i + 1 < argc) {
+            serverOptions.groupSize = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--group-window-ms" && i + 1 < argc) {
+            serverOptions.groupWindow = chrono::milliseconds(std::max(0, atoi(argv[++i])));
+#endif
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+#ifndef _WIN32
+    if (!connectPath.empty()) {
+        return runClient(connectPath, query);
+    }
+#endif
+    if (filename.empty() || (query.empty() && servePath.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!storeKind.empty() && storeKind != "text" && storeKind != "indexed" && storeKind != "segmented") {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    // Запрос только на чтение открывает хранилище без права записи, если
+    // --store не требует перевести его в другой формат и не нужно применять журнал
+    bool readOnly = servePath.empty() && query.substr(0, 3) == "SET" && isReadOnlyQuery(query) &&
+                    !needsConversion(filename, storeKind) && !walLeftOver(filename);
+    StoreLock lock;
+    if (!lock.open(filename, !readOnly)) {
+        cout << "Ошибка. Не удалось открыть файл блокировки " << filename << ".lock" << endl;
+        return 1;
+    }
+    
+    if (!servePath.empty()) {
+#ifndef _WIN32
+        // Оставшийся журнал применяется и новый журнал блокируется за одно
+        // владение блокировкой хранилища: иначе другой процесс мог бы принять
+        // журнал запускающегося сервера за брошенный, применить и удалить его
+        lock.lockExclusive();
+        lock.beginWrite();
+        SetStore* store = openStore(filename, storeKind, true, cout);
+        WriteAheadLog wal;
+        bool walOpened = store != nullptr && wal.open(walPath(filename));
+        lock.endWrite();
+        lock.unlock();
+        if (store == nullptr) {
+            return 1;
+        }
+        if (!walOpened) {
+            cout << "Ошибка. Не удалось открыть журнал " << walPath(filename) << " (или с файлом уже работает другой сервер)" << endl;
+            delete store;
+            return 1;
+        }
+        int status = runServer(servePath, filename, *store, serverOptions, lock, wal);
+        delete store;
+        return status;
+#else
+        cout << "Ошибка. Режим сервера доступен только в POSIX-системах." << endl;
+        return 1;
+#endif
+    }
+    // Определяем тип операции по первой букве
+    if (query.substr(0, 3) != "SET") {
+        cout << "Ошибка. Неизвестный тип команды." << endl;
+        return 1;
+    }
+    
+    // Чтение без блокировки: ответ печатается, только если за время запроса
+    // никто не писал в хранилище
+    if (readOnly) {
+        for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++) {
+            uint64_t started = lock.readBegin();
+            if (started % 2 == 0) {
+                ostringstream out;
+                bool opened = false;
+                try {
+                    opened = runQuery(filename, storeKind, query, false, out);
+                } catch (const exception&) {
+                    // Файл менялся прямо во время чтения — повторим
+                }
+                if (lock.readValid(started)) {
+                    cout << out.str();
+                    return opened ? 0 : 1;
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(1) * (attempt + 1));
+        }
+        lock.lockShared();
+        bool opened = runQuery(filename, storeKind, query, false, cout);
+        lock.unlock();
+        return opened ? 0 : 1;
+    }
+    
+    // Сегментированное хранилище: изменения разных множеств идут
+    // параллельно под общей блокировкой хранилища. Формат и журнал
+    // перепроверяются под ней — перевод и восстановление идут под исключительной
+    if (filesystem::is_directory(filename) && !needsConversion(filename, storeKind) && !walLeftOver(filename)) {
+        lock.lockShared();
+        SetLocks setLocks;
+        if (filesystem::is_directory(filename) && !walLeftOver(filename) &&
+            setLocks.acquire(filename, querySets(query))) {
+            // Без writable: перевод формата и журнал требуют исключительной блокировки
+            bool opened = runQuery(filename, storeKind, query, false, cout);
+            lock.unlock();
+            return opened ? 0 : 1;
+        }
+        lock.unlock();
+    }
+    
+    lock.lockExclusive();
+    lock.beginWrite();
+    bool opened = runQuery(filename, storeKind, query, true, cout);
+    lock.endWrite();
+    lock.unlock();
+    return opened ? 0 : 1;
 }